@@ -102,13 +102,18 @@ T* Allocator<T>::newElements(size_t elements) {
 					 << elements << " > " << block_size_ << std::endl;
 		return nullptr;
 	}
-	if(state_.remains < elements) {
-		if(state_.index == memory_.size() - 1)
-			memory_.push_back(new std::vector<T>(block_size_));
-		++state_.index;
-		state_.remains = block_size_;
+	T* mem;
+	// Nodes may be allocated from several threads
+#pragma omp critical (Allocator_newElements)
+	{
+		if(state_.remains < elements) {
+			if(state_.index == memory_.size() - 1)
+				memory_.push_back(new std::vector<T>(block_size_));
+			++state_.index;
+			state_.remains = block_size_;
+		}
+		mem = &((*memory_[state_.index])[block_size_ - state_.remains]);
+		state_.remains -= elements;
 	}
-	T* mem = &((*memory_[state_.index])[block_size_ - state_.remains]);
-	state_.remains -= elements;
 	return mem;
 }
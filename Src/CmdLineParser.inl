@@ -38,6 +38,33 @@ std::istream& operator>>(std::istream& ist, std::pair<T1, T2>& p) {
 	return ist >> p.first >> p.second;
 }
 
+// Lists are read and written as comma-separated values, e.g. "6,8,10"
+template<class T>
+std::ostream& operator<<(std::ostream& ost, std::vector<T> const& v) {
+	for(size_t i = 0; i != v.size(); ++i)
+		ost << (i ? "," : "") << v[i];
+	return ost;
+}
+
+template<class T>
+std::istream& operator>>(std::istream& ist, std::vector<T>& v) {
+	v.clear();
+	T t;
+	while(ist >> t) {
+		v.push_back(t);
+		if(ist.peek() != ',') break;
+		ist.ignore();
+	}
+	return ist;
+}
+
+inline std::istream& operator>>(std::istream& ist, std::vector<std::string>& v) {
+	v.clear();
+	std::string t;
+	while(std::getline(ist, t, ',')) v.push_back(t);
+	return ist;
+}
+
 template<class T>
 int cmdLine<T>::read(char** argv, int argc) {
 	if(argc <= 0) return 0;
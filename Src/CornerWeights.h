@@ -0,0 +1,205 @@
+#pragma once
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// The weights that the coefficients of an NxNxN block of nodes give to the corners of a cell are products
+// of per-axis weights, dx[axis][side][tap] for the side of the corner along the axis, and ddx their
+// derivatives. The sums over the block are contracted one axis at a time, so evaluating all eight corners
+// together costs about as much as evaluating two of them one at a time. Taps that do not touch the corner
+// of a side are zeroed and left out of the ranges [start, end).
+template<int N>
+class CornerWeights {
+public:
+	double dx[3][2][N];
+	double ddx[3][2][N];
+	int start[3][2];
+	int end[3][2];
+
+	// Restricts the side of the axis to the first N - 1 taps for side 0 and the last N - 1 for side 1,
+	// unless full
+	void setRange(int axis, int side, bool full) {
+		start[axis][side] = 0;
+		end[axis][side] = N;
+		if(full) return;
+		int tap = side ? 0 : N - 1;
+		dx[axis][side][tap] = ddx[axis][side][tap] = 0;
+		if(side) start[axis][side] = 1;
+		else end[axis][side] = N - 1;
+	}
+
+	// Adds the values of the block s to those of the corners, indexed by (cz << 2) | (cy << 1) | cx
+	void addValues(double const s[N][N][N], unsigned char corners, double values[8]) const {
+		int count = 0;
+		for(unsigned char c = corners; c; c &= c - 1) ++count;
+		if(count <= 2) {
+			for(int c = 0; c != 8; ++c)
+				if(corners & (1 << c)) values[c] += value(s, c & 1, (c >> 1) & 1, c >> 2);
+			return;
+		}
+		double v[2][2][2];
+#if defined(__SSE2__)
+		// The two sides along z in one register
+		__m128d z[N];
+		for(int k = 0; k != N; ++k) z[k] = _mm_set_pd(dx[2][1][k], dx[2][0][k]);
+		__m128d u[N][2];
+		for(int i = 0; i != N; ++i) {
+			u[i][0] = u[i][1] = _mm_setzero_pd();
+			for(int j = 0; j != N; ++j) {
+				__m128d t = _mm_setzero_pd();
+				for(int k = 0; k != N; ++k) t = _mm_add_pd(t, _mm_mul_pd(_mm_set1_pd(s[i][j][k]), z[k]));
+				u[i][0] = _mm_add_pd(u[i][0], _mm_mul_pd(_mm_set1_pd(dx[1][0][j]), t));
+				u[i][1] = _mm_add_pd(u[i][1], _mm_mul_pd(_mm_set1_pd(dx[1][1][j]), t));
+			}
+		}
+		for(int cx = 0; cx != 2; ++cx)
+			for(int cy = 0; cy != 2; ++cy) {
+				__m128d sum = _mm_setzero_pd();
+				for(int i = 0; i != N; ++i) sum = _mm_add_pd(sum, _mm_mul_pd(_mm_set1_pd(dx[0][cx][i]), u[i][cy]));
+				_mm_storeu_pd(v[cx][cy], sum);
+			}
+#else
+		double u[N][2][2] = {};
+		for(int i = 0; i != N; ++i)
+			for(int j = 0; j != N; ++j)
+				for(int cz = 0; cz != 2; ++cz) {
+					double t = 0;
+					for(int k = 0; k != N; ++k) t += dx[2][cz][k] * s[i][j][k];
+					for(int cy = 0; cy != 2; ++cy) u[i][cy][cz] += dx[1][cy][j] * t;
+				}
+		for(int cx = 0; cx != 2; ++cx)
+			for(int cy = 0; cy != 2; ++cy)
+				for(int cz = 0; cz != 2; ++cz) {
+					v[cx][cy][cz] = 0;
+					for(int i = 0; i != N; ++i) v[cx][cy][cz] += dx[0][cx][i] * u[i][cy][cz];
+				}
+#endif
+		for(int c = 0; c != 8; ++c)
+			if(corners & (1 << c)) values[c] += v[c & 1][(c >> 1) & 1][c >> 2];
+	}
+
+	// The value of the block s at the corner of sides cx, cy and cz
+	double value(double const s[N][N][N], int cx, int cy, int cz) const {
+		double value = 0;
+		for(int i = start[0][cx]; i != end[0][cx]; ++i) {
+			double u = 0;
+			for(int j = start[1][cy]; j != end[1][cy]; ++j) {
+				double t = 0;
+				for(int k = start[2][cz]; k != end[2][cz]; ++k) t += dx[2][cz][k] * s[i][j][k];
+				u += dx[1][cy][j] * t;
+			}
+			value += dx[0][cx][i] * u;
+		}
+		return value;
+	}
+
+	// Adds the gradients of the block s to those of the corners, as addValues does the values
+	void addGradients(double const s[N][N][N], unsigned char corners, double gradients[8][3]) const {
+		int count = 0;
+		for(unsigned char c = corners; c; c &= c - 1) ++count;
+		if(count <= 2) {
+			for(int c = 0; c != 8; ++c)
+				if(corners & (1 << c)) addGradient(s, c & 1, (c >> 1) & 1, c >> 2, gradients[c]);
+			return;
+		}
+		// The sums u, and du[0] and du[1] differentiated along y and z, of the block contracted along y and
+		// z, then contracted along x into the gradients in the same order as addGradient
+		double g[2][2][3][2];
+		for(int c = 0; c != 8; ++c)
+			for(int a = 0; a != 3; ++a) g[c & 1][(c >> 1) & 1][a][c >> 2] = gradients[c][a];
+#if defined(__SSE2__)
+		// The two sides along z in one register
+		__m128d z[N];
+		__m128d dz[N];
+		for(int k = 0; k != N; ++k) {
+			z[k] = _mm_set_pd(dx[2][1][k], dx[2][0][k]);
+			dz[k] = _mm_set_pd(ddx[2][1][k], ddx[2][0][k]);
+		}
+		__m128d u[N][2];
+		__m128d du[N][2][2];
+		for(int i = 0; i != N; ++i) {
+			for(int cy = 0; cy != 2; ++cy) u[i][cy] = du[i][cy][0] = du[i][cy][1] = _mm_setzero_pd();
+			for(int j = 0; j != N; ++j) {
+				__m128d t = _mm_setzero_pd();
+				__m128d dt = _mm_setzero_pd();
+				for(int k = 0; k != N; ++k) {
+					__m128d v = _mm_set1_pd(s[i][j][k]);
+					t = _mm_add_pd(t, _mm_mul_pd(z[k], v));
+					dt = _mm_add_pd(dt, _mm_mul_pd(dz[k], v));
+				}
+				for(int cy = 0; cy != 2; ++cy) {
+					__m128d y = _mm_set1_pd(dx[1][cy][j]);
+					__m128d dy = _mm_set1_pd(ddx[1][cy][j]);
+					u[i][cy] = _mm_add_pd(u[i][cy], _mm_mul_pd(y, t));
+					du[i][cy][0] = _mm_add_pd(du[i][cy][0], _mm_mul_pd(dy, t));
+					du[i][cy][1] = _mm_add_pd(du[i][cy][1], _mm_mul_pd(y, dt));
+				}
+			}
+		}
+		for(int cx = 0; cx != 2; ++cx)
+			for(int cy = 0; cy != 2; ++cy) {
+				__m128d sum[3];
+				for(int a = 0; a != 3; ++a) sum[a] = _mm_loadu_pd(g[cx][cy][a]);
+				for(int i = 0; i != N; ++i) {
+					__m128d x = _mm_set1_pd(dx[0][cx][i]);
+					sum[0] = _mm_add_pd(sum[0], _mm_mul_pd(_mm_set1_pd(ddx[0][cx][i]), u[i][cy]));
+					sum[1] = _mm_add_pd(sum[1], _mm_mul_pd(x, du[i][cy][0]));
+					sum[2] = _mm_add_pd(sum[2], _mm_mul_pd(x, du[i][cy][1]));
+				}
+				for(int a = 0; a != 3; ++a) _mm_storeu_pd(g[cx][cy][a], sum[a]);
+			}
+#else
+		double u[N][2][2] = {};
+		double du[N][2][2][2] = {};
+		for(int i = 0; i != N; ++i)
+			for(int j = 0; j != N; ++j)
+				for(int cz = 0; cz != 2; ++cz) {
+					double t = 0;
+					double dt = 0;
+					for(int k = 0; k != N; ++k) {
+						t += dx[2][cz][k] * s[i][j][k];
+						dt += ddx[2][cz][k] * s[i][j][k];
+					}
+					for(int cy = 0; cy != 2; ++cy) {
+						u[i][cy][cz] += dx[1][cy][j] * t;
+						du[i][cy][0][cz] += ddx[1][cy][j] * t;
+						du[i][cy][1][cz] += dx[1][cy][j] * dt;
+					}
+				}
+		for(int cx = 0; cx != 2; ++cx)
+			for(int cy = 0; cy != 2; ++cy)
+				for(int cz = 0; cz != 2; ++cz)
+					for(int i = 0; i != N; ++i) {
+						g[cx][cy][0][cz] += ddx[0][cx][i] * u[i][cy][cz];
+						g[cx][cy][1][cz] += dx[0][cx][i] * du[i][cy][0][cz];
+						g[cx][cy][2][cz] += dx[0][cx][i] * du[i][cy][1][cz];
+					}
+#endif
+		for(int c = 0; c != 8; ++c)
+			if(corners & (1 << c))
+				for(int a = 0; a != 3; ++a) gradients[c][a] = g[c & 1][(c >> 1) & 1][a][c >> 2];
+	}
+
+	// Adds the gradient of the block s at the corner of sides cx, cy and cz
+	void addGradient(double const s[N][N][N], int cx, int cy, int cz, double gradient[3]) const {
+		for(int i = start[0][cx]; i != end[0][cx]; ++i) {
+			double u = 0;
+			double du[2] = { 0, 0 };
+			for(int j = start[1][cy]; j != end[1][cy]; ++j) {
+				double t = 0;
+				double dt = 0;
+				for(int k = start[2][cz]; k != end[2][cz]; ++k) {
+					t += dx[2][cz][k] * s[i][j][k];
+					dt += ddx[2][cz][k] * s[i][j][k];
+				}
+				u += dx[1][cy][j] * t;
+				du[0] += ddx[1][cy][j] * t;
+				du[1] += dx[1][cy][j] * dt;
+			}
+			gradient[0] += ddx[0][cx][i] * u;
+			gradient[1] += dx[0][cx][i] * du[0];
+			gradient[2] += dx[0][cx][i] * du[1];
+		}
+	}
+};
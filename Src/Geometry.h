@@ -156,6 +156,28 @@ struct CoredVertexIndex {
 	bool inCore;
 };
 
+// Polygons stored back to back, the vertices of polygon i being indices[offsets[i]] to
+// indices[offsets[i + 1] - 1]. The lists are swapped rather than copied.
+struct PolygonList {
+	PolygonList(): offsets(1, 0) { }
+
+	size_t size() const { return offsets.size() - 1; }
+	int polygonSize(size_t i) const { return (int)(offsets[i + 1] - offsets[i]); }
+	int* operator[](size_t i) { return &indices[offsets[i]]; }
+	int const* operator[](size_t i) const { return &indices[offsets[i]]; }
+
+	void reserve(size_t pCount, size_t iCount) { offsets.reserve(pCount + 1); indices.reserve(iCount); }
+	void push_back(int const* polygon, int sz) {
+		indices.insert(indices.end(), polygon, polygon + sz);
+		offsets.push_back(indices.size());
+	}
+	void clear() { offsets.assign(1, 0); indices.clear(); }
+	void swap(PolygonList& polygons) { offsets.swap(polygons.offsets); indices.swap(polygons.indices); }
+
+	std::vector<size_t> offsets;
+	std::vector<int> indices;
+};
+
 class BufferedReadWriteFile {
 public:
 	BufferedReadWriteFile();
@@ -202,6 +224,9 @@ public:
 	int addPolygon(std::vector<CoredVertexIndex> const& vertices);
 	bool nextPolygon(std::vector<CoredVertexIndex>& vs) { return polygons_file_->read(vs); }
 	int polygonCount() { return polygon_count_; }
+
+	// Reads the whole mesh back in memory, the in-core points first as when written out
+	void getMesh(std::vector<Vertex>& vertices, PolygonList& polygons);
 private:
 	std::vector<Vertex> in_core_points_;
 	// This fields are here to ensure this structure has the exact same memory layout as
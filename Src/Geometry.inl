@@ -225,3 +225,24 @@ int CoredFileMeshData<Vertex>::addPolygon(std::vector<CoredVertexIndex> const& v
 	}
 	return sz;
 }
+
+template<class Vertex>
+void CoredFileMeshData<Vertex>::getMesh(std::vector<Vertex>& vertices, PolygonList& polygons) {
+	resetIterator();
+	int inCoreCount = inCorePointCount();
+	vertices.resize(inCoreCount + out_of_core_points_count_);
+	std::copy(in_core_points_.begin(), in_core_points_.end(), vertices.begin());
+	for(int i = 0; i != out_of_core_points_count_; ++i) nextOutOfCorePoint(vertices[inCoreCount + i]);
+
+	polygons.clear();
+	polygons.reserve(polygon_count_, 3 * (size_t)polygon_count_);
+	std::vector<CoredVertexIndex> polygon;
+	std::vector<int> indices;
+	for(int i = 0; i != polygon_count_; ++i) {
+		nextPolygon(polygon);
+		indices.resize(polygon.size());
+		for(size_t j = 0; j != polygon.size(); ++j)
+			indices[j] = polygon[j].inCore ? polygon[j].idx : polygon[j].idx + inCoreCount;
+		polygons.push_back(&indices[0], indices.size());
+	}
+}
@@ -27,15 +27,22 @@ DAMAGE.
 */
 #pragma once
 
+#include <cfloat>
+
 #include "Geometry.h"
 
 template<class Real>
 class MinimalAreaTriangulation {
 public:
+	// Polygons of up to this many vertices are triangulated bottom-up in fixed-size tables
+	static int const SMALL_SIZE = 8;
+
 	Real GetArea(std::vector<Point3D<Real> > const& vertices);
 	void GetTriangulation(std::vector<Point3D<Real> > const& vertices,
 			std::vector<TriangleIndex>& triangles);
 private:
+	void GetSmallTriangulation(std::vector<Point3D<Real> > const& vertices,
+			std::vector<TriangleIndex>& triangles) const;
 	Real GetArea(size_t i, size_t j, std::vector<Point3D<Real> > const& vertices);
 	void GetTriangulation(int i, int j, std::vector<Point3D<Real> > const& vertices,
 			std::vector<TriangleIndex>& triangles);
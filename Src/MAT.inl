@@ -51,8 +51,11 @@ void MinimalAreaTriangulation<Real>::GetTriangulation(
 		triangles.assign(tIndex[i], tIndex[i] + 2);
 		return;
 	}
-	data_.clear();
-	data_.resize(vertices.size() * vertices.size(), TriangulationData(-1, -1));
+	if(vertices.size() <= (size_t)SMALL_SIZE) {
+		GetSmallTriangulation(vertices, triangles);
+		return;
+	}
+	data_.assign(vertices.size() * vertices.size(), TriangulationData(-1, -1));
 	GetArea(0, 1, vertices);
 	triangles.clear();
 	GetTriangulation(0, 1, vertices, triangles);
@@ -60,11 +63,60 @@ void MinimalAreaTriangulation<Real>::GetTriangulation(
 
 template <class Real>
 Real MinimalAreaTriangulation<Real>::GetArea(std::vector<Point3D<Real> > const& vertices) {
-	data_.clear();
-	data_.resize(vertices.size() * vertices.size(), TriangulationData(-1, -1));
+	data_.assign(vertices.size() * vertices.size(), TriangulationData(-1, -1));
 	return GetArea(0, 1, vertices);
 }
 
+// The same triangulation as GetArea(0, 1) without recursion or allocation. The vertices are laid out
+// as the chain 1, ..., n, with n standing for the vertex 0, so that the region (i, j) of GetArea is the
+// chain from j to i, and each chain is split at the vertex of the triangle over its ends that gives the
+// smallest total area.
+template<class Real>
+void MinimalAreaTriangulation<Real>::GetSmallTriangulation(std::vector<Point3D<Real> > const& vertices,
+		std::vector<TriangleIndex>& triangles) const {
+	int n = (int)vertices.size();
+	Real area[SMALL_SIZE + 1][SMALL_SIZE + 1];
+	int mid[SMALL_SIZE + 1][SMALL_SIZE + 1];
+	for(int p = 1; p != n; ++p) area[p][p + 1] = 0;
+	for(int l = 2; l != n; ++l) {
+		for(int p = 1; p + l <= n; ++p) {
+			int q = p + l;
+			Real a = FLT_MAX;
+			int m = -1;
+			for(int r = p + 1; r != q; ++r) {
+				Real temp = Real(Length(CrossProduct(vertices[q % n] - vertices[r], vertices[p] - vertices[r])));
+				temp += area[r][q];
+				temp += area[p][r];
+				if(temp < a) {
+					a = temp;
+					m = r;
+				}
+			}
+			area[p][q] = a;
+			mid[p][q] = m;
+		}
+	}
+
+	// Emit the triangles in the order of GetTriangulation(0, 1)
+	triangles.clear();
+	int stack[SMALL_SIZE][2];
+	int size = 0;
+	stack[size][0] = 1;
+	stack[size++][1] = n;
+	while(size) {
+		--size;
+		int p = stack[size][0];
+		int q = stack[size][1];
+		if(q - p < 2 || mid[p][q] < 0) continue;
+		int m = mid[p][q];
+		triangles.push_back(TriangleIndex(q % n, p, m));
+		stack[size][0] = p;
+		stack[size++][1] = m;
+		stack[size][0] = m;
+		stack[size++][1] = q;
+	}
+}
+
 template<class Real>
 void MinimalAreaTriangulation<Real>::GetTriangulation(int i, int j,
 		std::vector<Point3D<Real> > const& vertices, std::vector<TriangleIndex>& triangles) {
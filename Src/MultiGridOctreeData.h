@@ -87,17 +87,49 @@ DAMAGE.
 #endif
 
 size_t const MEMORY_ALLOCATOR_BLOCK_SIZE = 1 << 12;
+// Side length (in voxels) of the blocks written out by the sparse voxel grid
+int const SPARSE_VOXEL_BLOCK_SIZE = 8;
+// Cells per block side of the lattice the blocks near the iso-surface are picked from
+int const SPARSE_VOXEL_SAMPLES = 2;
+// Depths by which the tree of an estimate is coarser than the requested one
+int const ESTIMATE_DEPTH_DROP = 2;
+// Ranges a full run's mesh counts, peak memory and solve time fell in, relative to their estimates, on the
+// bundled examples at depths 8 to 10 (with and without screening, density and a divided solver)
+double const ESTIMATE_MESH_LOW = 0.9;
+double const ESTIMATE_MESH_HIGH = 1.2;
+double const ESTIMATE_MEMORY_LOW = 0.9;
+double const ESTIMATE_MEMORY_HIGH = 1.25;
+double const ESTIMATE_TIME_LOW = 0.3;
+double const ESTIMATE_TIME_HIGH = 1.05;
+// Low bits of the samples of Octree::GetInteriorCells holding the depths they are splatted at
+int const SAMPLE_DEPTH_BITS = 6;
+// Bits per coordinate of the Morton keys used to sort points
+int const MORTON_KEY_BITS = 21;
+// For picking the depths automatically: the finest depth considered, the sample counts (relative to the
+// samples per node) of the cells of the finest and kernel depths, the share of a full tree the points
+// must occupy at the minimum depth and the modelled peak memory per occupied cell of the finest depth.
+// The samples per node picked along are at most those suggested for noisy samples.
+int const AUTO_DEPTH_MAX = 14;
+double const AUTO_DEPTH_SAMPLES = 2;
+double const AUTO_DEPTH_KERNEL_SAMPLES = 16;
+double const AUTO_DEPTH_MIN_OCCUPANCY = 8;
+double const AUTO_DEPTH_CELL_BYTES = 4096;
+double const AUTO_SAMPLES_PER_NODE_MAX = 20;
 
 #if !FORCE_NEUMANN_FIELD
 #pragma message("[WARNING] Not zeroing out normal component on boundary")
 #endif
 
 #include "BSplineData.h"
+#include "CornerWeights.h"
 #include "HashMap.h"
+#include "MAT.h"
 #include "Octree.h"
 #include "PPolynomial.h"
 #include "Ply.h"
+#include "PointStream.h"
 #include "SparseMatrix.h"
+#include "SplatWeights.h"
 #include "Time.h"
 
 typedef float Real;
@@ -171,10 +203,13 @@ struct TableData {
 	void setCount(int count) { count_ = count; }
 	void resizeOffsets(int size, int val) { offsets_.resize(size, val); }
 	void resizeTable(int size) { table_.resize(size); }
+	// Scratch space for the owned indices, kept across the tables set for successive subtrees
+	std::vector<int>& marks() { return marks_; }
 private:
 	int count_;
 	std::vector<IndicesS> table_;
 	std::vector<int> offsets_;
+	std::vector<int> marks_;
 };
 
 template<bool OutputDensity>
@@ -197,15 +232,41 @@ public:
 // TODO: setTable and getMaxCount between Corner and Edge share a lot of code. But straight up
 // TODO: extraction only makes it worse. Refactor it somehow.
 
-	void setCornerTable(CornerTableData& cData, TreeOctNode const* rootNode, int depth, int threads) const;
-	void setCornerTable(CornerTableData& cData, TreeOctNode const* rootNode, int threads) const
-		{ setCornerTable(cData, rootNode, maxDepth - 1, threads); }
-	int getMaxCornerCount(int depth, int maxDepth, int threads) const;
+// The owners are the corners and edges each node owns in the subtree of depth depth containing it, as bit
+// masks indexed by node. The tables of the subtrees can then take them instead of testing the ownership
+// again, and the counts of the subtrees follow from them.
+
+	void setCornerTable(CornerTableData& cData, TreeOctNode const* rootNode, int depth, int threads,
+			unsigned char const* owners = nullptr) const;
+	void setCornerTable(CornerTableData& cData, TreeOctNode const* rootNode, int threads,
+			unsigned char const* owners = nullptr) const
+		{ setCornerTable(cData, rootNode, maxDepth - 1, threads, owners); }
+	void getCornerOwners(int depth, int maxDepth, int threads, std::vector<unsigned char>& owners) const;
+
+	void setEdgeTable(EdgeTableData& eData, TreeOctNode const* rootNode, int depth, int threads,
+			unsigned short const* owners = nullptr);
+	void setEdgeTable(EdgeTableData& eData, TreeOctNode const* rootNode, int threads,
+			unsigned short const* owners = nullptr)
+		{ setEdgeTable(eData, rootNode, maxDepth - 1, threads, owners); }
+	void getEdgeOwners(int depth, int threads, std::vector<unsigned short>& owners) const;
+
+	// Sets spans[d][k] to the range of the nodes of depth d in the subtree of the k-th node of depth sDepth
+	void getSubtreeSpans(int sDepth, std::vector<std::vector<std::pair<int, int> > >& spans, int threads) const;
+	// Sets counts[k] to the number of corners (edges) owned by the subtree of the k-th node of depth sDepth
+	template<class Mask>
+	void getSubtreeCounts(int sDepth, std::vector<std::vector<std::pair<int, int> > > const& spans,
+			std::vector<Mask> const& owners, std::vector<int>& counts, int threads) const;
+};
 
-	void setEdgeTable(EdgeTableData& eData, TreeOctNode const* rootNode, int depth, int threads);
-	void setEdgeTable(EdgeTableData& eData, TreeOctNode const* rootNode, int threads)
-		{ setEdgeTable(eData, rootNode, maxDepth - 1, threads); }
-	int getMaxEdgeCount(TreeOctNode const* rootNode, int depth, int threads) const;
+// The input samples falling into one cell, merged before splatting: the average position, the summed
+// (unit, unless confidence is used) normals and their average length, the number of samples with a
+// normal and their summed density weight
+struct MergedSample {
+	Point3D<Real> position;
+	Point3D<Real> normal;
+	Real normalLength;
+	int count;
+	Real density;
 };
 
 struct PointData {
@@ -233,26 +294,21 @@ typedef Stencil<LaplacianStencil, 2> LaplacianStencils;
 typedef Stencil<double, 3> CenterEvaluationStencil;
 typedef Stencil<CenterEvaluationStencil, 2> CenterEvaluationStencils;
 
-typedef Stencil<Stencil<double, 3>, 2> CornerEvaluationStencil;
-typedef Stencil<CornerEvaluationStencil, 2> CornerEvaluationStencils;
-
-typedef Stencil<Stencil<Point3D<double>, 5>, 2> CornerNormalEvaluationStencil;
-typedef Stencil<CornerNormalEvaluationStencil, 2> CornerNormalEvaluationStencils;
-
 struct CenterValueStencil {
 	CenterEvaluationStencil stencil;
 	CenterEvaluationStencils stencils;
 };
 
-struct CornerValueStencil {
-	CornerEvaluationStencil stencil;
-	CornerEvaluationStencils stencils;
+// The corner weights of the interior nodes of a depth, for their 3x3x3 (5x5x5 for the normals) neighbors
+// and, by child index, for the neighbors of their parents
+template<int N>
+struct CornerStencil {
+	CornerWeights<N> weights;
+	CornerWeights<N> pWeights[8];
 };
 
-struct CornerNormalStencil {
-	CornerNormalEvaluationStencil stencil;
-	CornerNormalEvaluationStencils stencils;
-};
+typedef CornerStencil<3> CornerValueStencil;
+typedef CornerStencil<5> CornerNormalStencil;
 
 struct UpSampleData {
 	UpSampleData(): start(0) {
@@ -310,6 +366,45 @@ struct Range3D {
 	int zEnd;
 };
 
+// Narrow-band voxel grid stored as a list of blockRes^3 blocks. Block b has block coordinates
+// blocks[3*b+0..2] and its values (x fastest) start at values[b*blockRes^3].
+struct SparseVoxelGrid {
+	int res;
+	int blockRes;
+	std::vector<int> blocks;
+	std::vector<Real> values;
+
+	int blockCount() const { return (int)blocks.size() / 3; }
+};
+
+// Depths and samples per node picked by Octree::SelectDepths, with the per-depth statistics they were
+// picked from: the number of occupied cells, the shares of points whose cell holds at least
+// AUTO_DEPTH_SAMPLES (and AUTO_DEPTH_KERNEL_SAMPLES) times the samples per node, and the points by the
+// number of points in their cell, up to the most that can set the samples per node
+struct DepthSelection {
+	int maxDepth;
+	int kernelDepth;
+	int minDepth;
+	Real samplesPerNode;
+	std::vector<long long> cells;
+	std::vector<double> denseFraction;
+	std::vector<double> kernelDenseFraction;
+	std::vector<std::vector<long long> > cellSamples;
+};
+
+// Predicted cost of solving and meshing a finalized tree, per depth from the coarsest solved one. The
+// node counts are replayed on the cells of the points, the remaining figures are modelled. The node error
+// is that of the replay checked against the coarser tree the estimate is made from, and the mesh growth
+// is the factor the mesh of that tree is to be scaled up by.
+struct ReconstructionEstimate {
+	std::vector<long long> nodes;
+	std::vector<long long> entries;
+	double meshGrowth;
+	double solveTime;
+	double peakMemory;
+	double nodeError;
+};
+
 template<int Degree, bool OutputDensity>
 class Octree {
 public:
@@ -322,14 +417,24 @@ public:
 
 	Octree(int threads, int maxDepth, BoundaryType boundaryType);
 
-	void finalize(int subdivisionDepth);
+	void finalize(int subdivisionDepth, bool newOnly = false);
 	std::vector<Real> GetSolutionGrid(int& res, Real isoValue, int depth);
+	SparseVoxelGrid GetSparseSolutionGrid(Real isoValue, int depth, int band);
+	static DepthSelection SelectDepths(std::string const& fileName, XForm<Real, 4> const& xForm,
+			Real scaleFactor, Real samplesPerNode, double memoryBudget, int threads);
+	ReconstructionEstimate GetEstimate(std::string const& fileName, XForm<Real, 4> const& xForm, int depth,
+			int mergeDepth, int subdivideDepth, int minIters, int maxSolveDepth, int fixedIters);
+	void GetSolutionValues(std::vector<Point3D<Real> > const& points, XForm<Real, 4> const& xForm,
+			Real isoValue, std::vector<Real>& values, std::vector<Point3D<Real> >* gradients) const;
 	int setTree(std::string const& fileName, int maxDepth, int minDepth, int kernelDepth, Real samplesPerNode,
 		Real scaleFactor, bool useConfidence, bool useNormalWeights, Real constraintWeight,
-		int adaptiveExponent, XForm<Real, 4> xForm);
+		int adaptiveExponent, XForm<Real, 4> xForm, bool incremental = false, int mergeDepth = 0);
+	int AppendPoints(std::string const& fileName, XForm<Real, 4> xForm, int subdivideDepth);
 
 	void SetLaplacianConstraints();
 	void ClipTree();
+	void TruncateTree(int depth);
+	void SetRegionOfInterest(Point3D<Real> const& min, Point3D<Real> const& max, XForm<Real, 4> xForm);
 	int LaplacianMatrixIteration(int subdivideDepth, bool showResidual, int minIters, double accuracy,
 			int maxSolveDepth, int fixedIters);
 
@@ -472,82 +577,6 @@ private:
 		CenterEvaluator1 const& evaluator;
 	};
 
-	class SetCornerEvaluationStencilFunction {
-	public:
-		SetCornerEvaluationStencilFunction(int depth, int center, CornerEvaluator2 const& evaluator):
-			depth(depth), center(center), evaluator(evaluator) { }
-		double operator()(int cx, int cy, int cz, int x, int y, int z) const {
-			int off[] = { center + x - 1, center + y - 1, center + z - 1 };
-			return evaluator.value(depth, center, cx, off[0], false, false) *
-				evaluator.value(depth, center, cy, off[1], false, false) *
-				evaluator.value(depth, center, cz, off[2], false, false);
-		}
-	private:
-		int depth;
-		int center;
-		CornerEvaluator2 const& evaluator;
-	};
-
-	class SetCornerEvaluationStencilsFunction {
-	public:
-		SetCornerEvaluationStencilsFunction(int depth, int center, CornerEvaluator2 const& evaluator):
-			depth(depth), center(center), evaluator(evaluator) { }
-		double operator()(int cx, int cy, int cz, int _cx, int _cy, int _cz,
-				int x, int y, int z) const {
-			int idx[] = { center + _cx, center + _cy, center + _cz };
-			int off[] = { center / 2 + x - 1, center / 2 + y - 1, center / 2 + z - 1 };
-			return evaluator.value(depth, idx[0], cx, off[0], false, true) *
-				evaluator.value(depth, idx[1], cy, off[1], false, true) *
-				evaluator.value(depth, idx[2], cz, off[2], false, true);
-		}
-	private:
-		int depth;
-		int center;
-		CornerEvaluator2 const& evaluator;
-	};
-
-	class SetCornerNormalEvaluationStencilFunction {
-	public:
-		SetCornerNormalEvaluationStencilFunction(int depth, int center, CornerEvaluator2 const& evaluator):
-			depth(depth), center(center), evaluator(evaluator) { }
-		Point3D<double> operator()(int cx, int cy, int cz, int x, int y, int z) const {
-			int off[] = { center + x - 2, center + y - 2, center + z - 2 };
-			double v[] = { evaluator.value(depth, center, cx, off[0], false, false),
-				evaluator.value(depth, center, cy, off[1], false, false),
-				evaluator.value(depth, center, cz, off[2], false, false) };
-			double dv[] = { evaluator.value(depth, center, cx, off[0], true, false),
-				evaluator.value(depth, center, cy, off[1], true, false),
-				evaluator.value(depth, center, cz, off[2], true, false) };
-			return Point3D<double>(dv[0] * v[1] * v[2], v[0] * dv[1] * v[2], v[0] * v[1] * dv[2]);
-		}
-	private:
-		int depth;
-		int center;
-		CornerEvaluator2 const& evaluator;
-	};
-
-	class SetCornerNormalEvaluationStencilsFunction {
-	public:
-		SetCornerNormalEvaluationStencilsFunction(int depth, int center, CornerEvaluator2 const& evaluator):
-			depth(depth), center(center), evaluator(evaluator) { }
-		Point3D<double> operator()(int cx, int cy, int cz, int _cx, int _cy, int _cz,
-				int x, int y, int z) const {
-			int idx[] = { center + _cx, center + _cy, center + _cz };
-			int off[] = { center / 2 + x - 2, center / 2 + y - 2, center / 2 + z - 2 };
-			double v[] = { evaluator.value(depth, idx[0], cx, off[0], false, true),
-				evaluator.value(depth, idx[1], cy, off[1], false, true),
-				evaluator.value(depth, idx[2], cz, off[2], false, true) };
-			double dv[] = { evaluator.value(depth, idx[0], cx, off[0], true, true),
-				evaluator.value(depth, idx[1], cy, off[1], true, true),
-				evaluator.value(depth, idx[2], cz, off[2], true, true) };
-			return Point3D<double>(dv[0] * v[1] * v[2], v[0] * dv[1] * v[2], v[0] * v[1] * dv[2]);
-		}
-	private:
-		int depth;
-		int center;
-		CornerEvaluator2 const& evaluator;
-	};
-
 	class UpSampleCoarserSolutionFunction {
 	public:
 		UpSampleCoarserSolutionFunction(Vector<Real>& Solution, size_t start):
@@ -700,11 +729,13 @@ private:
 		std::vector<Range3D> const& ranges;
 	};
 
+	// Returns the neighbors already set in the key for the node, which must be an ancestor of (or) the
+	// last node the key was set for, instead of walking the key down again
 	class SplatOrientedPointGetNeighborsFunction {
 	public:
 		SplatOrientedPointGetNeighborsFunction(TreeNeighborKey3& key): neighborKey(key) { }
 		TreeConstNeighbors3& operator()(TreeOctNode* node) const {
-			return (TreeConstNeighbors3&)neighborKey.setNeighbors(node);
+			return (TreeConstNeighbors3&)neighborKey.neighbors(node->depth());
 		}
 	private:
 		TreeNeighborKey3& neighborKey;
@@ -728,7 +759,7 @@ private:
 	template<class Vertex>
 	static int AddTriangles(CoredFileMeshData<Vertex>* mesh, std::vector<CoredPointIndex>& edges,
 			std::vector<Vertex>* interiorVertices, int offSet, bool polygonMesh,
-			std::vector<Vertex>* barycenters);
+			std::vector<Vertex>* barycenters, MinimalAreaTriangulation<Real>& MAT);
 	static std::vector<edges_t> GetEdgeLoops(edges_t& edges);
 	static int GetRootIndex(TreeOctNode const* node, int edgeIndex, int maxDepth,
 			TreeConstNeighborKey3& neighborKey3, RootInfo<OutputDensity>& ri);
@@ -737,9 +768,44 @@ private:
 	static int GetRootPair(RootInfo<OutputDensity> const& root, int maxDepth,
 			TreeConstNeighborKey3& neighborKey3, RootInfo<OutputDensity>& pair);
 	static bool IsInset(TreeOctNode const* node);
-
-	int refineBoundary(int subdivisionDepth);
+	static unsigned long long MortonKey(Point3D<Real> const& p);
+	static unsigned long long MortonKey(int const idx[3], int depth);
+	static void MortonCell(unsigned long long key, int depth, int idx[3]);
+	static void AddNeighborKeys(std::vector<unsigned long long> const& cells, int depth, bool parents,
+			std::vector<unsigned long long>& keys);
+	static void AddCells(std::vector<unsigned long long>& cells, std::vector<unsigned long long>& added,
+			int threads);
+	unsigned long long GetReplaySample(Point3D<Real> const& position, int maxDepth,
+			TreeConstNeighborKey3& neighborKey) const;
+	std::vector<std::vector<unsigned long long> > GetInteriorCells(std::vector<unsigned long long>& samples,
+			int maxDepth) const;
+	static void GetBoundingCube(PointStream<Real>* pointStream, XForm<Real, 4> const& xForm, Real scaleFactor,
+			Point3D<Real>& corner, Real& width, std::vector<Point3D<Real> >* points = nullptr);
+	static void AddDepthCell(DepthSelection& selection, int depth, size_t keys, Real samplesPerNode);
+	static bool Intersects(TreeOctNode const* node, Point3D<Real> const& min, Point3D<Real> const& max);
+	bool IsDirty(TreeOctNode const* node, int ring = 0) const;
+	bool IsNearDirty(TreeOctNode const* node) const;
+	bool IsSorted(TreeOctNode const* node) const;
+	int UpdatedNodes(int depth, std::vector<int> const*& nodes) const;
+	bool ClipNewChildren(TreeOctNode* node);
+
+	int refineBoundary(int subdivisionDepth, bool newOnly = false);
+	bool GetBoundaryRefinement(TreeOctNode* leaf, int sDepth, TreeNeighborKey3& neighborKey,
+			bool flags[3][3][3]) const;
+	void InitChildren(std::vector<std::vector<TreeOctNode*> >& parents, std::vector<TreeOctNode*>& interior) const;
+	void SetRegionOfInterestFlags(std::vector<char>& flags) const;
+	void SetSolutionGridSpan(BSplineData<Degree, Real> const& fData, int res, TreeOctNode const* node,
+			int idx[3], int start[3], int end[3]) const;
+	void AddGridValues(BSplineData<Degree, Real> const& fData, int res, TreeOctNode const* node,
+			std::vector<int> const axes[3], Real* values) const;
 	bool inBounds(Point3D<Real>) const;
+	void AddSampleDensity(Point3D<Real> const& p, Real weight, int splatDepth, TreeNeighborKey3& neighborKey);
+	Real AddSample(Point3D<Real> const& p, Point3D<Real> n, Real normalLength, Real sampleWeight, int splatDepth,
+			int maxDepth, TreeNeighborKey3& neighborKey);
+	void MergeSamples(PointStream<Real>* pointStream, XForm<Real, 4> const& xForm, int depth,
+			std::vector<MergedSample>& samples) const;
+	void ScalePoints(bool inverse);
+	void ClampBoundaryNormals();
 	double GetLaplacian(Integrator const& integrator, int d, int const off1[3], int const off2[3],
 			bool childParent) const;
 	double GetDivergence1(Integrator const& integrator, int d, int const off1[3], int const off2[3],
@@ -756,6 +822,8 @@ private:
 	int SolveFixedDepthMatrix(int depth, Integrator const& integrator,
 			SortedTreeNodes<OutputDensity> const& sNodes, Real* subConstraints, int startingDepth,
 			bool showResidual, int minIters, double accuracy, bool noSolve, int fixedIters);
+	int SolveDirty(SparseSymmetricMatrix<Real> const& M, Vector<Real> const& B, std::vector<char> const& dirty,
+			int minIters, double accuracy, int fixedIters, Vector<Real>& X) const;
 	void SetMatrixRowBounds(TreeOctNode const* node, int rDepth, int const rOff[3], 
 			Range3D& range) const;
 	int GetMatrixRowSize(TreeNeighbors5 const& neighbors5, bool symmetric) const
@@ -774,12 +842,14 @@ private:
 	DivergenceStencils SetDivergenceStencils(int depth, Integrator const& integrator, bool scatter) const;
 	CenterEvaluationStencil SetCenterEvaluationStencil(CenterEvaluator1 const& evaluator, int depth) const;
 	CenterEvaluationStencils SetCenterEvaluationStencils(CenterEvaluator1 const& evaluator, int depth) const;
-	CornerEvaluationStencil SetCornerEvaluationStencil(CornerEvaluator2 const& evaluator, int depth) const;
-	CornerEvaluationStencils SetCornerEvaluationStencils(CornerEvaluator2 const& evaluator, int depth) const;
-	CornerNormalEvaluationStencil SetCornerNormalEvaluationStencil(CornerEvaluator2 const& evaluator,
-			int depth) const;
-	CornerNormalEvaluationStencils SetCornerNormalEvaluationStencils(CornerEvaluator2 const& evaluator,
-			int depth) const;
+	// Sets the corner weights of the node of depth depth and offset off for its NxNxN neighbors, or for
+	// those of its parent
+	template<int N>
+	void SetCornerWeights(CornerEvaluator2 const& evaluator, int depth, int const off[3], bool parent,
+			bool derivatives, CornerWeights<N>& weights) const;
+	template<int N>
+	void SetCornerStencil(CornerEvaluator2 const& evaluator, int depth, bool derivatives,
+			CornerStencil<N>& stencil) const;
 	void UpdateConstraintsFromCoarser(TreeNeighbors5 const& neighbors5, TreeNeighbors5 const& pNeighbors5,
 			TreeOctNode* node, Real const* metSolution, Integrator const& integrator,
 			Stencil<double, 5> const& stencil) const;
@@ -788,9 +858,11 @@ private:
 			Real* metSolution) const;
 	Vector<Real> UpSampleCoarserSolution(int depth, SortedTreeNodes<OutputDensity> const& sNodes) const;
 	template<class C>
-	void DownSample(int depth, SortedTreeNodes<OutputDensity> const& sNodes, C* constraints) const;
+	void DownSample(int depth, SortedTreeNodes<OutputDensity> const& sNodes, C* constraints,
+			std::vector<int> const* nodes = nullptr) const;
 	template<class C>
-	void UpSample(int depth, SortedTreeNodes<OutputDensity> const& sNodes, C* coefficients) const;
+	void UpSample(int depth, SortedTreeNodes<OutputDensity> const& sNodes, C* coefficients,
+			std::vector<int> const* nodes = nullptr) const;
 	template<class C>
 	void UpSample(int depth, SortedTreeNodes<OutputDensity> const& sNodes, C const* coarseCoefficients,
 			C* fineCoefficients) const;
@@ -803,26 +875,43 @@ private:
 	SparseSymmetricMatrix<Real> GetRestrictedFixedDepthLaplacian(int depth, Integrator const& integrator,
 			std::vector<int> const& entries, int entryCount, TreeOctNode const* rNode, Real radius,
 			SortedTreeNodes<OutputDensity> const& sNodes, Real const* metSolution);
+	// Whether the corner values of the leaf can use the interior evaluation stencils
+	bool IsCornerInterior(TreeOctNode const* leaf) const;
+	// Evaluates the corners of the leaf set in the owned mask, so that each is evaluated once
+	void SetOwnedCornerValues(TreeOctNode const* leaf, unsigned char owned, CornerTableData const& cData,
+			char* valuesSet, Real* values, TreeConstNeighborKey3& nKey, std::vector<Real> const& metSolution,
+			CornerEvaluator2 const& evaluator, CornerValueStencil const& stencil);
 	void SetIsoCorners(Real isoValue, TreeOctNode* leaf, CornerTableData& cData, char* valuesSet,
 			Real* values, TreeConstNeighborKey3& nKey, std::vector<Real> const& metSolution,
-			CornerEvaluator2 const& evaluator, CornerEvaluationStencil const&, CornerEvaluationStencils const&);
+			CornerEvaluator2 const& evaluator, CornerValueStencil const& stencil);
+	// Adds the roots of the node on the boundary of the subtree to the mesh, and sets slots[e] to the edge
+	// table index of the interior root of its edge e that is not set yet, or -1
 	template<class Vertex>
 	int SetMCRootPositions(TreeOctNode* node, int sDepth, Real isoValue,
-			TreeConstNeighborKey3& neighborKey3, RootData<OutputDensity>& rootData,
-			std::vector<Vertex>* interiorVertices, CoredFileMeshData<Vertex>* mesh,
-			std::vector<Real> const& metSolution, CornerEvaluator2 const& evaluator,
-			CornerNormalEvaluationStencil const&, CornerNormalEvaluationStencils const&, bool nonLinearFit);
+			TreeConstNeighborKey3& neighborKey3, RootData<OutputDensity>& rootData, int* slots,
+			CoredFileMeshData<Vertex>* mesh, std::vector<Real> const& metSolution,
+			CornerEvaluator2 const& evaluator, CornerNormalStencil const& nStencil, bool nonLinearFit);
+	// Sets the interior roots claimed in slots to their vertices, at their indices minus offSet. The corner
+	// normals are evaluated by the node instead of being shared through rootData, so that the vertices do
+	// not depend on which leaf got to a corner first.
+	template<class Vertex>
+	void SetMCInteriorRoots(TreeOctNode* node, int sDepth, Real isoValue,
+			TreeConstNeighborKey3& neighborKey3, RootData<OutputDensity>& rootData, int const* slots,
+			std::vector<Vertex>& interiorVertices, int offSet, std::vector<Real> const& metSolution,
+			CornerEvaluator2 const& evaluator, CornerNormalStencil const& nStencil, bool nonLinearFit);
 	template<class Vertex>
 	int GetMCIsoTriangles(TreeOctNode* node, TreeConstNeighborKey3& neighborKey3,
 			CoredFileMeshData<Vertex>* mesh, RootData<OutputDensity>& rootData,
 			std::vector<Vertex>* interiorVertices, int offSet, int sDepth, bool polygonMesh,
-			std::vector<Vertex>* barycenters);
+			std::vector<Vertex>* barycenters, MinimalAreaTriangulation<Real>& MAT);
 	void GetMCIsoEdges(TreeOctNode* node, TreeConstNeighborKey3& neighborKey3, int sDepth, edges_t& edges);
+	// The normals at the corners of ri.node are taken from normals if given, and otherwise from (and into)
+	// the caches of rootData
 	template<class Vertex>
 	int GetRoot(RootInfo<OutputDensity> const& ri, Real isoValue, TreeConstNeighborKey3& neighborKey3,
 			Vertex& vertex, RootData<OutputDensity>& rootData, int sDepth, std::vector<Real> const& metSolution,
-			CornerEvaluator2 const& evaluator, CornerNormalEvaluationStencil const&,
-			CornerNormalEvaluationStencils const&, bool nonLinearFit);
+			CornerEvaluator2 const& evaluator, CornerNormalStencil const& nStencil, bool nonLinearFit,
+			Point3D<Real> const* normals = nullptr);
 	void UpdateWeightContribution(TreeOctNode* node, Point3D<Real> const& position,
 			TreeNeighborKey3& neighborKey, Real weight = 1.0) const;
 	Real GetSampleWeight(TreeOctNode const* node, Point3D<Real> const& position,
@@ -832,22 +921,29 @@ private:
 	void GetSampleDepthAndWeight(OctNodeS* node, Point3D<Real> const& position,
 			GetNeighbors const& getNeighbors, Real samplesPerNode, Real& depth, Real& weight) const;
 	void SplatOrientedPoint(TreeOctNode* node, Point3D<Real> const& point, Point3D<Real> const& normal,
-			TreeNeighborKey3& neighborKey);
+			TreeNeighbors3& neighbors);
 	Real SplatOrientedPoint(Point3D<Real> const& point, Point3D<Real> const& normal,
 			TreeNeighborKey3& neighborKey, int kernelDepth, Real samplesPerNode, int minDepth, int maxDepth);
 
-	bool HasNormals(TreeOctNode* node, Real epsilon) const;
+	bool HasNormal(TreeOctNode const* node) const;
+	void AddPointValue(TreeConstNeighbors3 const& neighbors, Point3D<Real> const& p,
+			Real const* coefficients, double& value, Point3D<double>* gradient) const;
+	void AddFinerPointValue(TreeOctNode const* node, Point3D<Real> const& p, double& value,
+			Point3D<double>* gradient) const;
 	Real getCenterValue(TreeConstNeighborKey3 const& neighborKey3, TreeOctNode const* node,
 			std::vector<Real> const& metSolution, CenterEvaluator1 const& evaluator,
 			Stencil<double, 3> const& stencil, Stencil<double, 3> const& pStencil, bool isInterior) const;
-	Real getCornerValue(TreeConstNeighborKey3 const& neighborKey3, TreeOctNode const* node, int corner,
-			std::vector<Real> const& metSolution, CornerEvaluator2 const& evaluator,
-			Stencil<double, 3> const& stencil, CornerEvaluationStencil const& stencils, bool isInterior) const;
-	Point3D<Real> getCornerNormal(TreeConstNeighbors5 const& neighbors5,
-			TreeConstNeighbors5 const& pNeighbors5, TreeOctNode const* node, int corner,
+	// Set values[c] (normals[c]) for the corners c of the node in the corners mask
+	void getCornerValues(TreeConstNeighborKey3 const& neighborKey3, TreeOctNode const* node,
+			unsigned char corners, std::vector<Real> const& metSolution, CornerEvaluator2 const& evaluator,
+			CornerValueStencil const& stencil, bool isInterior, Real values[8]) const;
+	void getCornerNormals(TreeConstNeighbors5 const& neighbors5, TreeConstNeighbors5 const& pNeighbors5,
+			TreeOctNode const* node, unsigned char corners, std::vector<Real> const& metSolution,
+			CornerEvaluator2 const& evaluator, CornerNormalStencil const& nStencil, bool isInterior,
+			Point3D<Real> normals[8]) const;
+	void getCornerNormals(TreeConstNeighborKey3& neighborKey3, TreeOctNode const* node, unsigned char corners,
 			std::vector<Real> const& metSolution, CornerEvaluator2 const& evaluator,
-			Stencil<Point3D<double>, 5> const& nStencil, CornerNormalEvaluationStencil const&,
-			bool isInterior) const;
+			CornerNormalStencil const& nStencil, Point3D<Real> normals[8]) const;
 private:
 	static size_t maxMemoryUsage_;
 
@@ -863,10 +959,30 @@ private:
 	SortedTreeNodes<OutputDensity> sNodes_;
 	Real samplesPerNode_;
 	int splatDepth_;
+	bool useConfidence_;
+	bool useNormalWeights_;
+	int adaptiveExponent_;
+	Real constraintWeight_;
+	double pointWeightSum_;
+	int pointCount_;
+	bool incremental_;
+	std::vector<TreeOctNode*> sampleNodes_;
+	std::vector<std::pair<TreeOctNode*, Real> > sampleDensities_;
+	bool hasDirtyRegion_;
+	Point3D<Real> dirtyMin_;
+	Point3D<Real> dirtyMax_;
+	int dirtyDepth_;
+	// The sorted indices of the nodes that IsNearDirty, per depth
+	std::vector<std::vector<int> > nearDirty_;
 	int minDepth_;
 	Real scale_;
 	Point3D<Real> center_;
 	std::vector<PointData> points_;
+	bool hasRegionOfInterest_;
+	Point3D<Real> roiMin_;
+	Point3D<Real> roiMax_;
+	// The subdivision depth the boundary was last refined for, or -1 once the tree has changed since
+	int refinedSubdivideDepth_;
 };
 
 #include "MultiGridOctreeData.inl"
@@ -27,13 +27,13 @@ DAMAGE.
 */
 
 #include <cassert>
+#include <limits>
 
 #include "DumpOutput.h"
 #include "Octree.h"
 #include "time.h"
 #include "MemoryUsage.h"
 #include "PointStream.h"
-#include "MAT.h"
 #include "Util.h"
 
 double const ITERATION_POWER = 1.0 / 3;
@@ -88,7 +88,7 @@ void SortedTreeNodes<OutputDensity>::set(TreeOctNode& root) {
 
 template<bool OutputDensity>
 void SortedTreeNodes<OutputDensity>::setCornerTable(CornerTableData& cData, TreeOctNode const* rootNode,
-		int maxDepth, int threads) const {
+		int maxDepth, int threads, unsigned char const* owners) const {
 	if(threads <= 0) threads = 1;
 	cData.resizeOffsets(this->maxDepth, -1);
 	// The vector of per-depth node spans
@@ -123,14 +123,15 @@ void SortedTreeNodes<OutputDensity>::setCornerTable(CornerTableData& cData, Tree
 	}
 
 	cData.resizeTable(nodeCount);
-	int count = 0;
 	TreeConstNeighborKey3 neighborKey(maxDepth);
-	std::vector<int> cIndices(nodeCount * Cube::CORNERS, 0);
+	std::vector<int>& cIndices = cData.marks();
+	cIndices.assign(nodeCount * Cube::CORNERS, 0);
 	for(int d = minDepth; d <= maxDepth; ++d) {
 #pragma omp parallel for num_threads(threads) firstprivate(neighborKey)
 		for(int i = spans[d].first; i < spans[d].second; ++i) {
 			TreeOctNode* node = treeNodes[i];
 			if(d < maxDepth && node->hasChildren()) continue;
+			if(owners && !owners[i]) continue;
 			typename TreeOctNode::ConstNeighbors3 const& neighbors =
 				neighborKey.getNeighbors3(node, minDepth);
 			for(unsigned c = 0; c != Cube::CORNERS; ++c)	{ // Iterate over the cell's corners
@@ -140,7 +141,8 @@ void SortedTreeNodes<OutputDensity>::setCornerTable(CornerTableData& cData, Tree
 				int z;
 				Cube::FactorCornerIndex(c, x, y, z);
 				unsigned ac = Cube::AntipodalCornerIndex(c); // The index of the node relative to the corner
-				for(unsigned cc = 0; cc != Cube::CORNERS; ++cc) { // Iterate over the corner's cells
+				if(owners) cornerOwner = (owners[i] >> c) & 1;
+				else for(unsigned cc = 0; cc != Cube::CORNERS; ++cc) { // Iterate over the corner's cells
 					int xx;
 					int yy;
 					int zz;
@@ -192,8 +194,7 @@ void SortedTreeNodes<OutputDensity>::setCornerTable(CornerTableData& cData, Tree
 			}
 		}
 	}
-	for(size_t i = 0; i != cIndices.size(); ++i)
-		if(cIndices[i]) cIndices[i] = count++;
+	int count = ParallelRank(cIndices, cIndices.size(), threads);
 	for(int d = minDepth; d <= maxDepth; ++d)
 #pragma omp parallel for num_threads(threads)
 		for(int i = spans[d].first; i < spans[d].second; ++i)
@@ -202,19 +203,39 @@ void SortedTreeNodes<OutputDensity>::setCornerTable(CornerTableData& cData, Tree
 	cData.setCount(count);
 }
 
+// The children of the nodes in a span are contiguous at the next depth, from the first child of the
+// first node with children to the last child of the last one
+template<bool OutputDensity>
+void SortedTreeNodes<OutputDensity>::getSubtreeSpans(int sDepth,
+		std::vector<std::vector<std::pair<int, int> > >& spans, int threads) const {
+	int count = nodeCount[sDepth + 1] - nodeCount[sDepth];
+	spans.assign(maxDepth, std::vector<std::pair<int, int> >(count, std::pair<int, int>(0, 0)));
+	for(int k = 0; k != count; ++k)
+		spans[sDepth][k] = std::pair<int, int>(nodeCount[sDepth] + k, nodeCount[sDepth] + k + 1);
+	for(int d = sDepth + 1; d < maxDepth; ++d)
+#pragma omp parallel for num_threads(threads)
+		for(int k = 0; k < count; ++k) {
+			int start = spans[d - 1][k].first;
+			int end = spans[d - 1][k].second;
+			while(start < end && !treeNodes[start]->hasChildren()) ++start;
+			while(end > start && !treeNodes[end - 1]->hasChildren()) --end;
+			if(start != end)
+				spans[d][k] = std::pair<int, int>(treeNodes[start]->child(0)->nodeData.nodeIndex,
+						treeNodes[end - 1]->child(7)->nodeData.nodeIndex + 1);
+		}
+}
+
 template<bool OutputDensity>
-int SortedTreeNodes<OutputDensity>::getMaxCornerCount(int depth, int maxDepth, int threads) const {
+void SortedTreeNodes<OutputDensity>::getCornerOwners(int depth, int maxDepth, int threads,
+		std::vector<unsigned char>& owners) const {
 	if(threads <= 0) threads = 1;
-	int res = 1 << depth;
+	owners.assign(nodeCount[maxDepth + 1], 0);
 
-	std::vector<int> cornerCount(res * res * res, 0);
 	TreeConstNeighborKey3 neighborKey(maxDepth);
 #pragma omp parallel for num_threads(threads) firstprivate(neighborKey)
 	for(int i = nodeCount[depth]; i < nodeCount[maxDepth + 1]; ++i) {
 		TreeOctNode* node = treeNodes[i];
-		int d;
-		int off[3];
-		node->depthAndOffset(d, off);
+		int d = node->depth();
 		if(d < maxDepth && node->hasChildren()) continue;
 
 		typename TreeOctNode::ConstNeighbors3 const& neighbors = neighborKey.getNeighbors3(node, depth);
@@ -238,20 +259,14 @@ int SortedTreeNodes<OutputDensity>::getMaxCornerCount(int depth, int maxDepth, i
 						break;
 					}
 			}
-			if(cornerOwner)
-#pragma omp atomic
-				++cornerCount[((off[0] >> (d - depth)) * res * res) + ((off[1] >> (d - depth)) * res) +
-					(off[2] >> (d - depth))];
+			if(cornerOwner) owners[i] |= 1 << c;
 		}
 	}
-	int maxCount = 0;
-	for(int i = 0; i != res * res * res; ++i) maxCount = std::max(maxCount, cornerCount[i]);
-	return maxCount;
 }
 
 template<bool OutputDensity>
 void SortedTreeNodes<OutputDensity>::setEdgeTable(EdgeTableData& eData, TreeOctNode const* rootNode,
-		int maxDepth, int threads) {
+		int maxDepth, int threads, unsigned short const* owners) {
 	if(threads <= 0) threads = 1;
 	std::vector<std::pair<int, int> > spans(this->maxDepth, std::pair<int, int>(-1, -1));
 
@@ -285,12 +300,13 @@ void SortedTreeNodes<OutputDensity>::setEdgeTable(EdgeTableData& eData, TreeOctN
 		}
 	}
 	eData.resizeTable(nodeCount);
-	std::vector<int> eIndices(nodeCount * Cube::EDGES, 0);
-	int count = 0;
+	std::vector<int>& eIndices = eData.marks();
+	eIndices.assign(nodeCount * Cube::EDGES, 0);
 	TreeConstNeighborKey3 neighborKey(maxDepth);
 	for(int d = minDepth; d <= maxDepth; ++d) {
 #pragma omp parallel for num_threads(threads) firstprivate(neighborKey)
 		for(int i = spans[d].first; i < spans[d].second; ++i) {
+			if(owners && !owners[i]) continue;
 			TreeOctNode* node = treeNodes[i];
 			typename TreeOctNode::ConstNeighbors3 const& neighbors = neighborKey.getNeighbors3(node, minDepth);
 
@@ -301,7 +317,8 @@ void SortedTreeNodes<OutputDensity>::setEdgeTable(EdgeTableData& eData, TreeOctN
 				int _j;
 				Cube::FactorEdgeIndex(e, o, _i, _j);
 				unsigned ac = Square::AntipodalCornerIndex(Square::CornerIndex(_i, _j));
-				for(unsigned cc = 0; cc != Square::CORNERS; ++cc) {
+				if(owners) edgeOwner = (owners[i] >> e) & 1;
+				else for(unsigned cc = 0; cc != Square::CORNERS; ++cc) {
 					int ii;
 					int jj;
 					int x = 0;
@@ -349,7 +366,7 @@ void SortedTreeNodes<OutputDensity>::setEdgeTable(EdgeTableData& eData, TreeOctN
 			}
 		}
 	}
-	for(size_t i = 0; i != eIndices.size(); ++i) if(eIndices[i]) eIndices[i] = count++;
+	int count = ParallelRank(eIndices, eIndices.size(), threads);
 	for(int d = minDepth; d <= maxDepth; ++d)
 #pragma omp parallel for num_threads(threads)
 		for(int i = spans[d].first; i < spans[d].second; ++i)
@@ -359,26 +376,22 @@ void SortedTreeNodes<OutputDensity>::setEdgeTable(EdgeTableData& eData, TreeOctN
 }
 
 template<bool OutputDensity>
-int SortedTreeNodes<OutputDensity>::getMaxEdgeCount(TreeOctNode const*, int depth, int threads) const {
+void SortedTreeNodes<OutputDensity>::getEdgeOwners(int depth, int threads,
+		std::vector<unsigned short>& owners) const {
 	if(threads <= 0) threads = 1;
-	int res = 1 << depth;
-	std::vector<int> edgeCount(res * res * res, 0);
+	owners.assign(nodeCount[maxDepth], 0);
 	TreeConstNeighborKey3 neighborKey(maxDepth -1);
 #pragma omp parallel for num_threads(threads) firstprivate(neighborKey)
 	for(int i = nodeCount[depth]; i < nodeCount[maxDepth]; ++i) {
 		TreeOctNode* node = treeNodes[i];
 		typename TreeOctNode::ConstNeighbors3 const& neighbors = neighborKey.getNeighbors3(node, depth);
-		int d;
-		int off[3];
-		node->depthAndOffset(d, off);
-
 		for(unsigned e = 0; e != Cube::EDGES; ++e) {
 			bool edgeOwner = true;
 			int o;
-			int i;
-			int j;
-			Cube::FactorEdgeIndex(e, o, i, j);
-			unsigned ac = Square::AntipodalCornerIndex(Square::CornerIndex(i, j));
+			int _i;
+			int _j;
+			Cube::FactorEdgeIndex(e, o, _i, _j);
+			unsigned ac = Square::AntipodalCornerIndex(Square::CornerIndex(_i, _j));
 			for(unsigned cc = 0; cc != Square::CORNERS; ++cc) {
 				int ii;
 				int jj;
@@ -386,8 +399,8 @@ int SortedTreeNodes<OutputDensity>::getMaxEdgeCount(TreeOctNode const*, int dept
 				int y = 0;
 				int z = 0;
 				Square::FactorCornerIndex(cc, ii, jj);
-				ii += i;
-				jj += j;
+				ii += _i;
+				jj += _j;
 				switch(o) {
 					case 0: x = 1; y = ii; z = jj; break;
 					case 1: x = ii; y = 1; z = jj; break;
@@ -398,15 +411,28 @@ int SortedTreeNodes<OutputDensity>::getMaxEdgeCount(TreeOctNode const*, int dept
 					break;
 				}
 			}
-			if(edgeOwner)
-#pragma omp atomic
-				++edgeCount[((off[0] >> (d - depth)) * res * res) + ((off[1] >> (d - depth)) * res) +
-					(off[2] >> (d - depth))];
+			if(edgeOwner) owners[i] |= 1 << e;
 		}
 	}
-	int maxCount = 0;
-	for(int i = 0; i != res * res * res; ++i) maxCount = std::max(maxCount, edgeCount[i]);
-	return maxCount;
+}
+
+// A subtree owns the corners (edges) owned by its nodes, so its count is the number of bits set in their
+// masks, summed over its spans
+template<bool OutputDensity>
+template<class Mask>
+void SortedTreeNodes<OutputDensity>::getSubtreeCounts(int sDepth,
+		std::vector<std::vector<std::pair<int, int> > > const& spans, std::vector<Mask> const& owners,
+		std::vector<int>& counts, int threads) const {
+	int count = nodeCount[sDepth + 1] - nodeCount[sDepth];
+	counts.assign(count, 0);
+#pragma omp parallel for num_threads(threads)
+	for(int k = 0; k < count; ++k) {
+		int c = 0;
+		for(int d = sDepth; d < (int)spans.size(); ++d)
+			for(int i = spans[d][k].first; i < spans[d][k].second; ++i)
+				for(Mask mask = owners[i]; mask; mask &= mask - 1) ++c;
+		counts[k] = c;
+	}
 }
 
 ////////////
@@ -428,7 +454,12 @@ Octree<Degree, OutputDensity>::Octree(int threads, int maxDepth, BoundaryType bo
 	boundaryType_(boundaryType),
 	radius_(0.5 + 0.5 * Degree),
 	width_((int)((double)(radius_ + 0.5 - EPSILON) * 2)),
-	constrainValues_(false) {
+	constrainValues_(false),
+	incremental_(false),
+	hasDirtyRegion_(false),
+	dirtyDepth_(0),
+	hasRegionOfInterest_(false),
+	refinedSubdivideDepth_(-1) {
 	if(boundaryType_ == BoundaryTypeNone) ++maxDepth;
 	postDerivativeSmooth_ = (Real)1.0 / (1 << maxDepth);
 	fData_.set(maxDepth, (BoundaryType)boundaryType);
@@ -460,32 +491,29 @@ bool IsInsetSupported(TreeOctNode const* node) {
 
 template<int Degree, bool OutputDensity>
 void Octree<Degree, OutputDensity>::SplatOrientedPoint(TreeOctNode* node, Point3D<Real> const& position,
-		Point3D<Real> const& normal, TreeNeighborKey3& neighborKey) {
+		Point3D<Real> const& normal, TreeNeighbors3& neighbors) {
 	Point3D<Real> center;
 	Real w;
 	node->centerAndWidth(center, w);
 	double width = w;
-	double dx[DIMENSION][SPLAT_ORDER + 1];
+	SplatWeights weights;
 	int off[3];
-	for(int i = 0; i != 3; ++i) {
 #if SPLAT_ORDER == 2
-		off[i] = 0;
-		double x = (center[i] - position[i] - width) / width;
-		dx[i][0] = 1.125 + 1.5 * x + 0.5 * x * x;
-		x = (center[i] - position[i]) / width;
-		dx[i][1] = 0.75 - x * x;
-		dx[i][2] = 1 - dx[i][1] - dx[i][0];
+	off[0] = off[1] = off[2] = 0;
+	weights.setQuadratic(center, width, position);
 #elif SPLAT_ORDER == 1
+	for(int i = 0; i != 3; ++i) {
 		double x = (position[i] - center[i]) / width;
 		off[i] = x < 0 ? 0 : 1;
-		dx[i][0] = x < 0 ? -x : 1 - x;
-		dx[i][1] = 1 - dx[i][0];
+		weights.dx[i][off[i]] = x < 0 ? -x : 1 - x;
+		weights.dx[i][off[i] + 1] = 1 - weights.dx[i][off[i]];
+		weights.dx[i][2 - 2 * off[i]] = 0;
+	}
 #else
-		// There was also SPLAT_ORDER == 0 case but it fails on the original code and so is removed.
+	// There was also SPLAT_ORDER == 0 case but it fails on the original code and so is removed.
 #error Splat order not supported
 #endif
-	}
-	TreeNeighbors3& neighbors = neighborKey.setNeighbors(node);
+	weights.outerProduct();
 	for(int i = off[0]; i <= off[0] + SPLAT_ORDER; ++i) {
 		for(int j = off[1]; j <= off[1] + SPLAT_ORDER; ++j) {
 			for(int k = off[2]; k <= off[2] + SPLAT_ORDER; ++k) {
@@ -493,11 +521,12 @@ void Octree<Degree, OutputDensity>::SplatOrientedPoint(TreeOctNode* node, Point3
 				if(nnode) {
 					int idx = nnode->nodeData.normalIndex;
 					if(idx < 0) {
-						nnode->nodeData.nodeIndex = 0;
+						// The nodes sorted before keep their index, for IsSorted
+						if(nnode->nodeData.nodeIndex < 0) nnode->nodeData.nodeIndex = 0;
 						idx = nnode->nodeData.normalIndex = normals_.size();
 						normals_.push_back(Point3D<Real>());
 					}
-					normals_[idx] += normal * (Real)(dx[0][i] * dx[1][j] * dx[2][k]);
+					normals_[idx] += normal * (Real)weights(i, j, k);
 				}
 			}
 		}
@@ -529,6 +558,9 @@ Real Octree<Degree, OutputDensity>::SplatOrientedPoint(Point3D<Real> const& posi
 		myCenter[1] += cIndex & 2 ? myWidth / 2 : -myWidth / 2;
 		myCenter[2] += cIndex & 4 ? myWidth / 2 : -myWidth / 2;
 	}
+	// The neighbors are gathered once for the splatting node: the sample weights of its ancestors and the
+	// splats at and above the top depth read the levels of the key directly
+	neighborKey.setNeighbors(temp);
 	Real weight;
 	Real depth;
 	GetSampleDepthAndWeight(temp, position, SplatOrientedPointGetNeighborsFunction(neighborKey),
@@ -548,16 +580,17 @@ Real Octree<Degree, OutputDensity>::SplatOrientedPoint(Point3D<Real> const& posi
 		myCenter[1] += cIndex & 2 ? myWidth / 2 : -myWidth / 2;
 		myCenter[2] += cIndex & 4 ? myWidth / 2 : -myWidth / 2;
 	}
+	if(topDepth > splatDepth) neighborKey.setNeighbors(temp);
 	Real dx = 1 - (topDepth - depth);
 	double width = 1.0 / (1 << temp->depth());
 	Point3D<Real> n = normal * weight / (Real)std::pow(width, 3) * dx;
-	SplatOrientedPoint(temp, position, n, neighborKey);
+	SplatOrientedPoint(temp, position, n, neighborKey.neighbors(topDepth));
 	if(std::abs(1 - dx) > EPSILON) {
 		dx = 1 - dx;
 		temp = temp->parent();
 		width = 1.0 / (1 << temp->depth());
 		n = normal * weight / (Real)std::pow(width, 3) * dx;
-		SplatOrientedPoint(temp, position, n, neighborKey);
+		SplatOrientedPoint(temp, position, n, neighborKey.neighbors(topDepth - 1));
 	}
 	return weight;
 }
@@ -592,27 +625,21 @@ Real Octree<Degree, OutputDensity>::GetSampleWeight(TreeOctNode const* node, Poi
 	Point3D<Real> center;
 	Real w;
 	node->centerAndWidth(center, w);
-	double width = w;
-	double dx[DIMENSION][3];
-	for(int i = 0; i != DIMENSION; ++i) {
-		double x = (center[i] - position[i] - width) / width;
-		dx[i][0] = 1.125 + 1.5 * x + 0.5 * x * x;
-		x = (center[i] - position[i]) / width;
-		dx[i][1] = 0.75 - x * x;
-		dx[i][2] = 1 - dx[i][1] - dx[i][0];
-	}
+	SplatWeights weights;
+	weights.setQuadratic(center, w, position);
+	weights.outerProduct();
 
-	Real weight = 0;
-	for(int i = 0; i != 3; ++i) {
+	// The contributions are gathered, with the missing neighbors as zero, and summed in a vector
+	double contributions[9][4];
+	for(int i = 0; i != 3; ++i)
 		for(int j = 0; j != 3; ++j) {
 			for(int k = 0; k != 3; ++k) {
-				if(neighbors.at(i, j, k))
-					weight += (Real)(dx[0][i] * dx[1][j] * dx[2][k] *
-						neighbors.at(i, j, k)->nodeData.centerWeightContribution[0]);
+				TreeOctNode const* neighbor = neighbors.at(i, j, k);
+				contributions[3 * i + j][k] = neighbor ? neighbor->nodeData.centerWeightContribution[0] : 0;
 			}
+			contributions[3 * i + j][3] = 0;
 		}
-	}
-	return 1.0 / weight;
+	return (Real)(1.0 / weights.contract(contributions));
 }
 
 template<int Degree, bool OutputDensity>
@@ -621,28 +648,21 @@ void Octree<Degree, OutputDensity>::UpdateWeightContribution(TreeOctNode* node,
 	Point3D<Real> center;
 	Real w;
 	node->centerAndWidth(center, w);
-	double width = w;
 	double const SAMPLE_SCALE = 1 / (0.125 * 0.125 + 0.75 * 0.75 + 0.125 * 0.125);
 
-	double dx[DIMENSION][3];
-	for(int i = 0; i != DIMENSION; ++i) {
-		double x = (center[i] - position[i] - width) / width;
-		dx[i][0] = 1.125 + 1.5 * x + 0.5 * x * x;
-		x = (center[i] - position[i]) / width;
-		dx[i][1] = 0.75 - x * x;
-		dx[i][2] = 1 - dx[i][1] - dx[i][0];
-		// Note that we are splatting along a co-dimension one manifold, so uniform point samples
-		// do not generate a unit sample weight.
-		dx[i][0] *= SAMPLE_SCALE;
-	}
+	SplatWeights weights;
+	weights.setQuadratic(center, w, position);
+	// Note that we are splatting along a co-dimension one manifold, so uniform point samples
+	// do not generate a unit sample weight.
+	for(int i = 0; i != DIMENSION; ++i) weights.dx[i][0] *= SAMPLE_SCALE;
+	weights.outerProduct(weight);
 
 	TreeNeighbors3& neighbors = neighborKey.setNeighbors(node);
 	for(int i = 0; i != 3; ++i) {
 		for(int j = 0; j != 3; ++j) {
 			for(int k = 0; k != 3; ++k) {
 				if(neighbors.at(i, j, k))
-					neighbors.at(i, j, k)->nodeData.centerWeightContribution[0] +=
-						(Real)(dx[0][i] * dx[1][j] * weight * dx[2][k]);
+					neighbors.at(i, j, k)->nodeData.centerWeightContribution[0] += (Real)weights(i, j, k);
 			}
 		}
 	}
@@ -654,13 +674,161 @@ bool Octree<Degree, OutputDensity>::inBounds(Point3D<Real> p) const {
 	return p[0] >= e && p[0] <= 1 - e && p[1] >= e && p[1] <= 1 - e && p[2] >= e && p[2] <= 1 - e;
 }
 
+// Reads through the points once to get the corner and the width of their bounding cube, scaled by
+// scaleFactor about its center. If points is not null, the transformed points are also kept in it.
+template<int Degree, bool OutputDensity>
+void Octree<Degree, OutputDensity>::GetBoundingCube(PointStream<Real>* pointStream, XForm<Real, 4> const& xForm,
+		Real scaleFactor, Point3D<Real>& corner, Real& width, std::vector<Point3D<Real> >* points) {
+	// TODO: PointStream should move to proper c++ iterators
+	Point3D<Real> min;
+	Point3D<Real> max;
+	bool unassigned = true;
+	Point3D<Real> p;
+	Point3D<Real> n;
+	while(pointStream->nextPoint(p, n)) {
+		p = xForm * p;
+		for(int i = 0; i != DIMENSION; ++i) {
+			if(unassigned || p[i] < min[i]) min[i] = p[i];
+			if(unassigned || p[i] > max[i]) max[i] = p[i];
+		}
+		unassigned = false;
+		if(points) points->push_back(p);
+	}
+	width = std::max(max[0] - min[0], std::max(max[1] - min[1], max[2] - min[2]));
+	width *= scaleFactor;
+	corner = (max + min) / 2 - Point3D<Real>::ones() * (width / 2);
+}
+
+// Picks the depths from the occupancy of the grids over the points' bounding cube. The finest depth is
+// the deepest at which at least half of the points lie in cells holding AUTO_DEPTH_SAMPLES times the
+// samples per node, so that the finest nodes are not much smaller than the sample spacing (capped so
+// that the modelled peak memory stays within memoryBudget bytes, if positive). The kernel depth is the
+// deepest at which the cells hold AUTO_DEPTH_KERNEL_SAMPLES times as many, for a stable density
+// estimate, and the minimum depth the deepest at which the points still occupy a fair share of the
+// cells of a full tree. The depths are given in the convention of the command line, which does not count
+// the padding of BoundaryTypeNone. The samples per node are then raised to the finest depth's median sample
+// count over AUTO_DEPTH_SAMPLES (up to AUTO_SAMPLES_PER_NODE_MAX), so that a sample is splatted at the
+// finest depth where it is as dense as the typical one and coarser where it is sparser.
+template<int Degree, bool OutputDensity>
+DepthSelection Octree<Degree, OutputDensity>::SelectDepths(std::string const& fileName,
+		XForm<Real, 4> const& xForm, Real scaleFactor, Real samplesPerNode, double memoryBudget, int threads) {
+	// The points are kept from the pass that gets their bounding cube, so the file is only read once
+	std::vector<unsigned long long> keys;
+	{
+		std::vector<Point3D<Real> > points;
+		PointStream<Real>* pointStream = PointStream<Real>::open(fileName);
+		Point3D<Real> corner;
+		Real width;
+		GetBoundingCube(pointStream, xForm, scaleFactor, corner, width, &points);
+		delete pointStream;
+		keys.resize(points.size());
+#pragma omp parallel for num_threads(threads)
+		for(int i = 0; i < (int)points.size(); ++i) keys[i] = MortonKey((points[i] - corner) / width);
+	}
+	ParallelSort(keys, threads);
+
+	// The cells of a depth are the runs of keys sharing their prefix, each ended by a key that first differs
+	// from the one before it at that depth or a coarser one. The chunks of keys are scanned in parallel and
+	// the runs they cut are joined up afterwards. For each chunk and depth, runStarts holds the start of its
+	// last run and runEnds the end of its first one, or the end of the chunk if no run ends in it.
+	int const depths = AUTO_DEPTH_MAX + 1;
+	int chunks = std::max(threads, 1);
+	DepthSelection selection;
+	selection.cells.assign(depths, 0);
+	selection.denseFraction.assign(depths, 0);
+	selection.kernelDenseFraction.assign(depths, 0);
+	selection.cellSamples.assign(depths,
+			std::vector<long long>((size_t)(AUTO_DEPTH_SAMPLES * AUTO_SAMPLES_PER_NODE_MAX) + 1, 0));
+	std::vector<DepthSelection> chunkSelections(chunks, selection);
+	std::vector<std::vector<size_t> > runStarts(chunks, std::vector<size_t>(depths));
+	std::vector<std::vector<size_t> > runEnds(chunks, std::vector<size_t>(depths));
+#pragma omp parallel for num_threads(threads)
+	for(int c = 0; c < chunks; ++c) {
+		size_t start = keys.size() * c / chunks;
+		size_t end = keys.size() * (c + 1) / chunks;
+		runStarts[c].assign(depths, start);
+		runEnds[c].assign(depths, end);
+		for(size_t i = std::max<size_t>(start, 1); i < end; ++i) {
+			unsigned long long x = keys[i] ^ keys[i - 1];
+			if(!x) continue;
+			int depth = 1;
+			while(!(x >> 3 * (MORTON_KEY_BITS - depth))) ++depth;
+			for(int d = depth; d < depths; ++d) {
+				if(runEnds[c][d] == end) runEnds[c][d] = i;
+				else AddDepthCell(chunkSelections[c], d, i - runStarts[c][d], samplesPerNode);
+				runStarts[c][d] = i;
+			}
+		}
+	}
+	for(int d = 0; d < depths; ++d) {
+		size_t runStart = 0;
+		for(int c = 0; c != chunks; ++c) {
+			if(runEnds[c][d] == keys.size() * (c + 1) / chunks) continue;
+			if(runEnds[c][d] > runStart) AddDepthCell(selection, d, runEnds[c][d] - runStart, samplesPerNode);
+			runStart = runStarts[c][d];
+		}
+		if(keys.size() > runStart) AddDepthCell(selection, d, keys.size() - runStart, samplesPerNode);
+		for(int c = 0; c != chunks; ++c) {
+			selection.cells[d] += chunkSelections[c].cells[d];
+			selection.denseFraction[d] += chunkSelections[c].denseFraction[d];
+			selection.kernelDenseFraction[d] += chunkSelections[c].kernelDenseFraction[d];
+			for(size_t k = 0; k != selection.cellSamples[d].size(); ++k)
+				selection.cellSamples[d][k] += chunkSelections[c].cellSamples[d][k];
+		}
+		if(!keys.empty()) {
+			selection.denseFraction[d] /= keys.size();
+			selection.kernelDenseFraction[d] /= keys.size();
+		}
+	}
+
+	selection.maxDepth = 1;
+	selection.kernelDepth = 1;
+	selection.minDepth = 0;
+	for(int d = 1; d <= AUTO_DEPTH_MAX; ++d) {
+		if(selection.denseFraction[d] < 0.5) break;
+		if(memoryBudget > 0 && selection.cells[d] * AUTO_DEPTH_CELL_BYTES > memoryBudget) break;
+		selection.maxDepth = d;
+	}
+	// A kernel depth of 0 would turn off the density estimate
+	for(int d = 1; d < selection.maxDepth; ++d)
+		if(selection.kernelDenseFraction[d] >= 0.5) selection.kernelDepth = d;
+	for(int d = 0; d <= selection.kernelDepth; ++d)
+		if(selection.cells[d] * AUTO_DEPTH_MIN_OCCUPANCY >= (1ll << (3 * d))) selection.minDepth = d;
+	std::vector<long long> const& cellSamples = selection.cellSamples[selection.maxDepth];
+	size_t median = 0;
+	for(long long points = 0; median + 1 < cellSamples.size() && 2 * points < (long long)keys.size(); )
+		points += cellSamples[++median];
+	selection.samplesPerNode = clamp((Real)(median / AUTO_DEPTH_SAMPLES), samplesPerNode,
+			std::max(samplesPerNode, (Real)AUTO_SAMPLES_PER_NODE_MAX));
+	return selection;
+}
+
+// Counts a run of keys sharing their prefix at depth as a cell of the selection, and the keys as dense if
+// there are enough of them and by the size of the run. The shares of dense keys are left as counts.
+template<int Degree, bool OutputDensity>
+void Octree<Degree, OutputDensity>::AddDepthCell(DepthSelection& selection, int depth, size_t keys,
+		Real samplesPerNode) {
+	++selection.cells[depth];
+	if(keys >= AUTO_DEPTH_SAMPLES * samplesPerNode) selection.denseFraction[depth] += keys;
+	if(keys >= AUTO_DEPTH_KERNEL_SAMPLES * samplesPerNode) selection.kernelDenseFraction[depth] += keys;
+	selection.cellSamples[depth][std::min(keys, selection.cellSamples[depth].size() - 1)] += keys;
+}
+
 template<int Degree, bool OutputDensity>
 int Octree<Degree, OutputDensity>::setTree(std::string const& fileName, int maxDepth, int minDepth,
 		int splatDepth, Real samplesPerNode, Real scaleFactor, bool useConfidence,
-		bool useNormalWeights, Real constraintWeight, int adaptiveExponent, XForm<Real, 4> xForm) {
+		bool useNormalWeights, Real constraintWeight, int adaptiveExponent, XForm<Real, 4> xForm,
+		bool incremental, int mergeDepth) {
 	if(splatDepth < 0) splatDepth = 0;
 	samplesPerNode_ = samplesPerNode;
 	splatDepth_ = splatDepth;
+	useConfidence_ = useConfidence;
+	useNormalWeights_ = useNormalWeights;
+	adaptiveExponent_ = adaptiveExponent;
+	constraintWeight_ = constraintWeight;
+	incremental_ = incremental;
+	hasDirtyRegion_ = false;
+	refinedSubdivideDepth_ = -1;
 	constrainValues_ = constraintWeight > 0;
 
 	XForm<Real, 3> xFormN = xForm.cut<3>().transpose().inverse();
@@ -673,60 +841,122 @@ int Octree<Degree, OutputDensity>::setTree(std::string const& fileName, int maxD
 	TreeNeighborKey3 neighborKey(maxDepth);
 	PointStream<Real>* pointStream = PointStream<Real>::open(fileName);
 
-	// TODO: PointStream should move to proper c++ iterators
-	{
-		Point3D<Real> min;
-		Point3D<Real> max;
-		bool unassigned = true;
+	GetBoundingCube(pointStream, xForm, boundaryType_ == BoundaryTypeNone ? 2 * scaleFactor : scaleFactor,
+			center_, scale_);
+
+	// Merge the samples in each cell of the merge depth so that they are splatted once
+	std::vector<MergedSample> samples;
+	bool merge = mergeDepth > 0;
+	if(merge) {
+		if(boundaryType_ == BoundaryTypeNone) ++mergeDepth;
+		MergeSamples(pointStream, xForm, std::min(mergeDepth, MORTON_KEY_BITS), samples);
+	}
+
+	tree_.setFullDepth(minDepth_);
+	if(splatDepth > 0) {
+		if(merge)
+			for(size_t i = 0; i != samples.size(); ++i)
+				AddSampleDensity(samples[i].position, samples[i].density, splatDepth, neighborKey);
+		else {
+			pointStream->reset();
+			Point3D<Real> p;
+			Point3D<Real> n;
+			while(pointStream->nextPoint(p, n)) {
+				p = (xForm * p - center_) / scale_;
+				n = xFormN * n;
+				if(!inBounds(p)) continue;
+				AddSampleDensity(p, useConfidence ? Length(n) : 1, splatDepth, neighborKey);
+			}
+		}
+	}
+
+	double pointWeightSum = 0;
+	normals_.clear();
+	int cnt = 0;
+	if(merge)
+		for(size_t i = 0; i != samples.size(); ++i) {
+			MergedSample const& sample = samples[i];
+			// A cell whose normals cancel out still carries the screening weight of its samples
+			if(!sample.count) continue;
+			pointWeightSum += sample.count * AddSample(sample.position, sample.normal, sample.normalLength,
+					(Real)sample.count, splatDepth, maxDepth, neighborKey);
+			cnt += sample.count;
+		}
+	else {
+		pointStream->reset();
 		Point3D<Real> p;
 		Point3D<Real> n;
-		// Read through once to get the center and scale
 		while(pointStream->nextPoint(p, n)) {
-			p = xForm * p;
-			for(int i = 0; i != DIMENSION; ++i) {
-				if(unassigned || p[i] < min[i]) min[i] = p[i];
-				if(unassigned || p[i] > max[i]) max[i] = p[i];
-			}
-			unassigned = false;
+			p = (xForm * p - center_) / scale_;
+			n = xFormN * (-n);
+			if(!inBounds(p)) continue;
+			Real normalLength = Length(n);
+			if(normalLength <= EPSILON) continue;
+			if(!useConfidence) n /= normalLength;
+			pointWeightSum += AddSample(p, n, normalLength, 1, splatDepth, maxDepth, neighborKey);
+			++cnt;
 		}
-		scale_ = std::max(max[0] - min[0], std::max(max[1] - min[1], max[2] - min[2]));
-		scale_ *= boundaryType_ == BoundaryTypeNone ? 2 * scaleFactor : scaleFactor;
-		center_ = (max + min) / 2 - Point3D<Real>::ones() * (scale_ / 2);
 	}
+	pointWeightSum_ = pointWeightSum;
+	pointCount_ = cnt;
 
-	tree_.setFullDepth(minDepth_);
+	MemoryUsage();
+	delete pointStream;
+	ScalePoints(false);
+	ClampBoundaryNormals();
+	MemoryUsage();
+	return cnt;
+}
+
+// Splats the points of another file into the tree built by setTree (which must have been called with
+// incremental set) using the same center, scale and parameters, then clips and finalizes the new nodes.
+// Points outside of the original bounding cube are dropped. The weights of the earlier samples are not
+// re-estimated against the new density.
+// The nodes the new samples are splatted into and the normals they change, with the supports of those
+// and their screening positions, make up the dirty region. The old nodes are kept as they are, so only
+// the new ones are clipped and refined for, and the next solve only updates the coefficients of the
+// nodes no wider than the region whose B-splines reach it, the others keeping their solution. The
+// constraints, coarser values and system rows that feeds are only set up near the region (IsNearDirty),
+// and the iso-surface is only extracted where the function changes. The walks over the tree to restore
+// and scale the samples, the sorting of the nodes and the coarse pass of the extraction stay global.
+template<int Degree, bool OutputDensity>
+int Octree<Degree, OutputDensity>::AppendPoints(std::string const& fileName, XForm<Real, 4> xForm,
+		int subdivideDepth) {
+	if(!incremental_) {
+		std::cerr << "[ERROR] Octree::AppendPoints: the tree was not set up for incremental updates" <<
+			std::endl;
+		return 0;
+	}
+	refinedSubdivideDepth_ = -1;
+	int maxDepth = fData_.depth();
+	int splatDepth = boundaryType_ == BoundaryTypeNone && splatDepth_ > 0 ? splatDepth_ + 1 : splatDepth_;
+	XForm<Real, 3> xFormN = xForm.cut<3>().transpose().inverse();
+
+	// Restore the splatting state that the constraints and the iso-surface extraction wrote over
+	for(TreeOctNode* node = tree_.nextNode(); node; node = tree_.nextNode(node))
+		node->nodeData.normalIndex = -1;
+	for(size_t i = 0; i != sampleNodes_.size(); ++i)
+		if(sampleNodes_[i]) sampleNodes_[i]->nodeData.normalIndex = (int)i;
+	for(size_t i = 0; i != sampleDensities_.size(); ++i)
+		sampleDensities_[i].first->nodeData.centerWeightContribution[0] = sampleDensities_[i].second;
+	ScalePoints(true);
+	std::vector<Point3D<Real> > normals(normals_);
+
+	TreeNeighborKey3 neighborKey(maxDepth);
+	PointStream<Real>* pointStream = PointStream<Real>::open(fileName);
 	if(splatDepth > 0) {
-		pointStream->reset();
 		Point3D<Real> p;
 		Point3D<Real> n;
 		while(pointStream->nextPoint(p, n)) {
 			p = (xForm * p - center_) / scale_;
 			n = xFormN * n;
 			if(!inBounds(p)) continue;
-			Point3D<Real> myCenter(0.5, 0.5, 0.5);
-			Real myWidth = 1;
-			Real weight = useConfidence ? Length(n) : 1;
-			TreeOctNode* temp = &tree_;
-			int d = 0;
-			while(d < splatDepth) {
-				UpdateWeightContribution(temp, p, neighborKey, weight);
-				if(!temp->hasChildren()) temp->initChildren();
-				int cIndex = TreeOctNode::CornerIndex(myCenter, p);
-				temp = temp->child(cIndex);
-				myWidth /= 2;
-				myCenter[0] += (cIndex & 1 ? 1 : -1) * myWidth / 2;
-				myCenter[1] += (cIndex & 2 ? 1 : -1) * myWidth / 2;
-				myCenter[2] += (cIndex & 4 ? 1 : -1) * myWidth / 2;
-				++d;
-			}
-			UpdateWeightContribution(temp, p, neighborKey, weight);
+			AddSampleDensity(p, useConfidence_ ? Length(n) : 1, splatDepth, neighborKey);
 		}
+		pointStream->reset();
 	}
 
-	double pointWeightSum = 0;
-	normals_.clear();
 	int cnt = 0;
-	pointStream->reset();
 	Point3D<Real> p;
 	Point3D<Real> n;
 	while(pointStream->nextPoint(p, n)) {
@@ -735,62 +965,92 @@ int Octree<Degree, OutputDensity>::setTree(std::string const& fileName, int maxD
 		if(!inBounds(p)) continue;
 		Real normalLength = Length(n);
 		if(normalLength <= EPSILON) continue;
-		if(!useConfidence) n /= normalLength;
+		if(!useConfidence_) n /= normalLength;
+		pointWeightSum_ += AddSample(p, n, normalLength, 1, splatDepth, maxDepth, neighborKey);
+		for(int i = 0; i != 3; ++i) {
+			if(!cnt || p[i] < dirtyMin_[i]) dirtyMin_[i] = p[i];
+			if(!cnt || p[i] > dirtyMax_[i]) dirtyMax_[i] = p[i];
+		}
+		++cnt;
+	}
+	pointCount_ += cnt;
+	delete pointStream;
 
-		if(samplesPerNode > 0 && splatDepth) {
-			pointWeightSum += SplatOrientedPoint(p, n, neighborKey, splatDepth, samplesPerNode,
-					minDepth_, maxDepth);
-		} else {
-			TreeOctNode* temp = &tree_;
-			Point3D<Real> myCenter(0.5, 0.5, 0.5);
-			Real myWidth = 1;
-			int d = 0;
-			if(splatDepth) {
-				while(d < splatDepth) {
-					int cIndex = TreeOctNode::CornerIndex(myCenter, p);
-					temp = temp->child(cIndex);
-					myWidth /= 2;
-					myCenter[0] += (cIndex & 1 ? 1 : -1) * myWidth / 2;
-					myCenter[1] += (cIndex & 2 ? 1 : -1) * myWidth / 2;
-					myCenter[2] += (cIndex & 4 ? 1 : -1) * myWidth / 2;
-					++d;
-				}
-				Real pointWeight = 
-					GetSampleWeight(temp, p, (TreeConstNeighbors3&)neighborKey.setNeighbors(temp));
-				n *= pointWeight;
-				pointWeightSum += pointWeight;
-			}
-			while(d < maxDepth) {
-				if(!temp->hasChildren()) temp->initChildren();
-				int cIndex = TreeOctNode::CornerIndex(myCenter, p);
-				temp = temp->child(cIndex);
-				myWidth /= 2;
-				myCenter[0] += (cIndex & 1 ? 1 : -1) * myWidth / 2;
-				myCenter[1] += (cIndex & 2 ? 1 : -1) * myWidth / 2;
-				myCenter[2] += (cIndex & 4 ? 1 : -1) * myWidth / 2;
-				++d;
-			}
-			SplatOrientedPoint(temp, p, n, neighborKey);
+	ScalePoints(false);
+	ClampBoundaryNormals();
+
+	// A normal reaches the constraints of the B-splines overlapping its own, whose centers are within one
+	// and a half nodes of its node, so the region is grown by the node around each new or changed normal.
+	// The new children of the old nodes are clipped as ClipTree would.
+	std::vector<TreeOctNode*> parents;
+	for(TreeOctNode* node = tree_.nextNode(); node; node = tree_.nextNode(node)) {
+		if(IsSorted(node) && node->hasChildren() && !IsSorted(node->child(0))) parents.push_back(node);
+		int idx = node->nodeData.normalIndex;
+		if(idx < 0 || (idx < (int)normals.size() && normals_[idx] == normals[idx])) continue;
+		Point3D<Real> center;
+		Real width;
+		node->centerAndWidth(center, width);
+		for(int i = 0; i != 3; ++i) {
+			dirtyMin_[i] = std::min(dirtyMin_[i], center[i] - (Real)1.5 * width);
+			dirtyMax_[i] = std::max(dirtyMax_[i], center[i] + (Real)1.5 * width);
 		}
-		if(constrainValues_) {
-			Real pointScreeningWeight = useNormalWeights ? normalLength : 1;
-			TreeOctNode* temp = &tree_;
-			Point3D<Real> myCenter(0.5, 0.5, 0.5);
-			Real myWidth = 1;
-			int d = 0;
-			while(1) {
-				int idx = temp->nodeData.pointIndex;
-				if(idx == -1) {
-					idx = points_.size();
-					points_.push_back(PointData(p * pointScreeningWeight, pointScreeningWeight));
-					temp->nodeData.pointIndex = idx;
-				} else {
-					points_[idx].weight += pointScreeningWeight;
-					points_[idx].position += p * pointScreeningWeight;
-				}
+	}
+	for(size_t i = 0; i != parents.size(); ++i) ClipNewChildren(parents[i]);
+	hasDirtyRegion_ = cnt > 0;
+	Real extent = 0;
+	for(int i = 0; i != 3; ++i) extent = std::max(extent, dirtyMax_[i] - dirtyMin_[i]);
+	dirtyDepth_ = minDepth_;
+	while(dirtyDepth_ < maxDepth && (Real)1 / (1 << dirtyDepth_) > extent) ++dirtyDepth_;
+
+	// The old nodes keep their coefficients and the new ones start from zero
+	finalize(subdivideDepth, true);
+	nearDirty_.assign(sNodes_.maxDepth, std::vector<int>());
+	for(int d = 0; d != sNodes_.maxDepth; ++d)
+		for(int i = sNodes_.nodeCount[d]; i != sNodes_.nodeCount[d + 1]; ++i)
+			if(IsNearDirty(sNodes_.treeNodes[i])) nearDirty_[d].push_back(i);
+	MemoryUsage();
+	return cnt;
+}
+
+template<int Degree, bool OutputDensity>
+void Octree<Degree, OutputDensity>::AddSampleDensity(Point3D<Real> const& p, Real weight, int splatDepth,
+		TreeNeighborKey3& neighborKey) {
+	Point3D<Real> myCenter(0.5, 0.5, 0.5);
+	Real myWidth = 1;
+	TreeOctNode* temp = &tree_;
+	int d = 0;
+	while(d < splatDepth) {
+		UpdateWeightContribution(temp, p, neighborKey, weight);
+		if(!temp->hasChildren()) temp->initChildren();
+		int cIndex = TreeOctNode::CornerIndex(myCenter, p);
+		temp = temp->child(cIndex);
+		myWidth /= 2;
+		myCenter[0] += (cIndex & 1 ? 1 : -1) * myWidth / 2;
+		myCenter[1] += (cIndex & 2 ? 1 : -1) * myWidth / 2;
+		myCenter[2] += (cIndex & 4 ? 1 : -1) * myWidth / 2;
+		++d;
+	}
+	UpdateWeightContribution(temp, p, neighborKey, weight);
+}
 
+// Splats the oriented sample and its screening position, and returns its splatting weight. The sample
+// stands for sampleWeight points at the position, whose normals (of unit length unless confidence is
+// used) add up to n and whose normal lengths average normalLength.
+template<int Degree, bool OutputDensity>
+Real Octree<Degree, OutputDensity>::AddSample(Point3D<Real> const& p, Point3D<Real> n, Real normalLength,
+		Real sampleWeight, int splatDepth, int maxDepth, TreeNeighborKey3& neighborKey) {
+	Real pointWeight = 0;
+
+	if(samplesPerNode_ > 0 && splatDepth) {
+		pointWeight = SplatOrientedPoint(p, n, neighborKey, splatDepth, samplesPerNode_, minDepth_, maxDepth);
+	} else {
+		TreeOctNode* temp = &tree_;
+		Point3D<Real> myCenter(0.5, 0.5, 0.5);
+		Real myWidth = 1;
+		int d = 0;
+		if(splatDepth) {
+			while(d < splatDepth) {
 				int cIndex = TreeOctNode::CornerIndex(myCenter, p);
-				if(!temp->hasChildren()) break;
 				temp = temp->child(cIndex);
 				myWidth /= 2;
 				myCenter[0] += (cIndex & 1 ? 1 : -1) * myWidth / 2;
@@ -798,26 +1058,136 @@ int Octree<Degree, OutputDensity>::setTree(std::string const& fileName, int maxD
 				myCenter[2] += (cIndex & 4 ? 1 : -1) * myWidth / 2;
 				++d;
 			}
+			pointWeight = GetSampleWeight(temp, p, (TreeConstNeighbors3&)neighborKey.setNeighbors(temp));
+			n *= pointWeight;
+		}
+		while(d < maxDepth) {
+			if(!temp->hasChildren()) temp->initChildren();
+			int cIndex = TreeOctNode::CornerIndex(myCenter, p);
+			temp = temp->child(cIndex);
+			myWidth /= 2;
+			myCenter[0] += (cIndex & 1 ? 1 : -1) * myWidth / 2;
+			myCenter[1] += (cIndex & 2 ? 1 : -1) * myWidth / 2;
+			myCenter[2] += (cIndex & 4 ? 1 : -1) * myWidth / 2;
+			++d;
+		}
+		SplatOrientedPoint(temp, p, n, neighborKey.setNeighbors(temp));
+	}
+	if(constrainValues_) {
+		Real pointScreeningWeight = (useNormalWeights_ ? normalLength : 1) * sampleWeight;
+		TreeOctNode* temp = &tree_;
+		Point3D<Real> myCenter(0.5, 0.5, 0.5);
+		Real myWidth = 1;
+		while(1) {
+			int idx = temp->nodeData.pointIndex;
+			if(idx == -1) {
+				idx = points_.size();
+				points_.push_back(PointData(p * pointScreeningWeight, pointScreeningWeight));
+				temp->nodeData.pointIndex = idx;
+			} else {
+				points_[idx].weight += pointScreeningWeight;
+				points_[idx].position += p * pointScreeningWeight;
+			}
+
+			int cIndex = TreeOctNode::CornerIndex(myCenter, p);
+			if(!temp->hasChildren()) break;
+			temp = temp->child(cIndex);
+			myWidth /= 2;
+			myCenter[0] += (cIndex & 1 ? 1 : -1) * myWidth / 2;
+			myCenter[1] += (cIndex & 2 ? 1 : -1) * myWidth / 2;
+			myCenter[2] += (cIndex & 4 ? 1 : -1) * myWidth / 2;
 		}
-		++cnt;
 	}
+	return pointWeight * sampleWeight;
+}
+
+// Reads the samples in bounds and merges those sharing a cell at the given depth. The samples are sorted
+// by cell (and input order within a cell) so that the sums do not depend on the number of threads.
+template<int Degree, bool OutputDensity>
+void Octree<Degree, OutputDensity>::MergeSamples(PointStream<Real>* pointStream, XForm<Real, 4> const& xForm,
+		int depth, std::vector<MergedSample>& samples) const {
+	XForm<Real, 3> xFormN = xForm.cut<3>().transpose().inverse();
+	std::vector<Point3D<Real> > positions;
+	std::vector<Point3D<Real> > normals;
+	pointStream->reset();
+	Point3D<Real> p;
+	Point3D<Real> n;
+	while(pointStream->nextPoint(p, n)) {
+		p = (xForm * p - center_) / scale_;
+		if(!inBounds(p)) continue;
+		positions.push_back(p);
+		normals.push_back(xFormN * (-n));
+	}
+
+	int shift = 3 * (MORTON_KEY_BITS - depth);
+	std::vector<std::pair<unsigned long long, int> > keys(positions.size());
+#pragma omp parallel for num_threads(threads_)
+	for(int i = 0; i < (int)positions.size(); ++i)
+		keys[i] = std::make_pair(MortonKey(positions[i]) >> shift, i);
+	ParallelSort(keys, threads_);
+
+	std::vector<size_t> starts;
+	for(size_t i = 0; i != keys.size(); ++i)
+		if(!i || keys[i].first != keys[i - 1].first) starts.push_back(i);
+	starts.push_back(keys.size());
+
+	samples.resize(starts.size() - 1);
+#pragma omp parallel for num_threads(threads_)
+	for(int i = 0; i < (int)samples.size(); ++i) {
+		Point3D<double> position;
+		Point3D<double> normal;
+		double normalLength = 0;
+		double density = 0;
+		int count = 0;
+		for(size_t j = starts[i]; j != starts[i + 1]; ++j) {
+			int idx = keys[j].second;
+			Real length = (Real)Length(normals[idx]);
+			position += Point3D<double>(positions[idx]);
+			density += useConfidence_ ? length : 1;
+			if(length <= EPSILON) continue;
+			normal += Point3D<double>(useConfidence_ ? normals[idx] : normals[idx] / length);
+			normalLength += length;
+			++count;
+		}
+		MergedSample& sample = samples[i];
+		sample.position = Point3D<Real>(position / (double)(starts[i + 1] - starts[i]));
+		sample.normal = Point3D<Real>(normal);
+		sample.normalLength = count ? (Real)(normalLength / count) : 0;
+		sample.count = count;
+		sample.density = (Real)density;
+	}
+}
 
+// Turns the accumulated screening positions and weights into averaged positions with depth-adapted
+// weights, or back when inverse is set.
+template<int Degree, bool OutputDensity>
+void Octree<Degree, OutputDensity>::ScalePoints(bool inverse) {
+	if(!constrainValues_) return;
+	int maxDepth = fData_.depth();
+	double pointWeightSum = pointWeightSum_;
 	if(boundaryType_ == BoundaryTypeNone) pointWeightSum *= 4;
-	constraintWeight *= pointWeightSum / cnt;
+	Real constraintWeight = constraintWeight_;
+	constraintWeight *= pointWeightSum / pointCount_;
 
-	MemoryUsage();
-	delete pointStream;
-	if(constrainValues_)
-		for(TreeOctNode* node = tree_.nextNode(); node; node = tree_.nextNode(node))
-			if(node->nodeData.pointIndex != -1) {
-				int idx = node->nodeData.pointIndex;
+	for(TreeOctNode* node = tree_.nextNode(); node; node = tree_.nextNode(node))
+		if(node->nodeData.pointIndex != -1) {
+			int idx = node->nodeData.pointIndex;
+			int nd = boundaryType_ == BoundaryTypeNone ? node->depth() - 1 : node->depth();
+			int md = boundaryType_ == BoundaryTypeNone ? maxDepth - 1 : maxDepth;
+			int e = nd * adaptiveExponent_ - md * (adaptiveExponent_ - 1);
+			Real mul = e < 0 ? (Real)1 / (1 << (-e)) : 1 << e;
+			if(inverse) {
+				points_[idx].weight /= mul * constraintWeight;
+				points_[idx].position *= points_[idx].weight;
+			} else {
 				points_[idx].position /= points_[idx].weight;
-				int nd = boundaryType_ == BoundaryTypeNone ? node->depth() - 1 : node->depth();
-				int md = boundaryType_ == BoundaryTypeNone ? maxDepth - 1 : maxDepth;
-				int e = nd * adaptiveExponent - md * (adaptiveExponent - 1);
-				Real mul = e < 0 ? (Real)1 / (1 << (-e)) : 1 << e;
 				points_[idx].weight *= mul * constraintWeight;
 			}
+		}
+}
+
+template<int Degree, bool OutputDensity>
+void Octree<Degree, OutputDensity>::ClampBoundaryNormals() {
 #if FORCE_NEUMANN_FIELD
 	if(boundaryType_ == BoundaryTypeNeumann)
 		for(TreeOctNode* node = tree_.nextNode(); node; node = tree_.nextNode(node)) {
@@ -831,25 +1201,94 @@ int Octree<Degree, OutputDensity>::setTree(std::string const& fileName, int maxD
 				if(off[i] == 0 || off[i] == res - 1) normal[i] = 0;
 		}
 #endif // FORCE_NEUMANN_FIELD
-	MemoryUsage();
-	return cnt;
 }
 
+// Gives children to the distinct nodes of the per-thread lists, in parallel, and appends them to the list of
+// nodes with children
+template<int Degree, bool OutputDensity>
+void Octree<Degree, OutputDensity>::InitChildren(std::vector<std::vector<TreeOctNode*> >& parents,
+		std::vector<TreeOctNode*>& interior) const {
+	for(size_t t = 1; t < parents.size(); ++t) {
+		parents[0].insert(parents[0].end(), parents[t].begin(), parents[t].end());
+		parents[t].clear();
+	}
+	std::vector<TreeOctNode*>& nodes = parents[0];
+	std::sort(nodes.begin(), nodes.end());
+	nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+#pragma omp parallel for num_threads(threads_)
+	for(int i = 0; i < (int)nodes.size(); ++i)
+		nodes[i]->initChildren();
+	interior.insert(interior.end(), nodes.begin(), nodes.end());
+	nodes.clear();
+}
+
+// Refines the tree so that the 2-ring of every node's grandparent has children, one depth at a time from
+// the finest. At each depth the neighbors of the grandparents' ancestors are created from the top down,
+// as setting their neighbor keys would, then the grandparents' neighbors are given children. With newOnly,
+// the tree was finalized for the same subdivision depth before any node was added since the nodes were
+// last sorted, so only the grandparents of the added nodes are refined for.
 template<int Degree, bool OutputDensity>
-void Octree<Degree, OutputDensity>::finalize(int subdivideDepth) {
+void Octree<Degree, OutputDensity>::finalize(int subdivideDepth, bool newOnly) {
 	int maxDepth = tree_.maxDepth();
-	TreeNeighborKey3 nKey(maxDepth);
-	for(int d = maxDepth; d > 1; --d)
-		for(TreeOctNode* node = tree_.nextNode(); node; node = tree_.nextNode(node))
-			if(node->depth() == d) {
-				TreeNeighbors3& neighbors = nKey.setNeighbors(node->parent()->parent());
-				for(int i = 0; i != 3; ++i)
-					for(int j = 0; j != 3; ++j)
-						for(int k = 0; k != 3; ++k)
-							if(neighbors.at(i, j, k) && !neighbors.at(i, j, k)->hasChildren())
-								neighbors.at(i, j, k)->initChildren();
+	// The nodes with children at each depth
+	std::vector<std::vector<TreeOctNode*> > interior(maxDepth + 1);
+	for(TreeOctNode* node = tree_.nextNode(); node; node = tree_.nextNode(node))
+		if(node->hasChildren()) interior[node->depth()].push_back(node);
+	std::vector<std::vector<TreeOctNode*> > parents(std::max(threads_, 1));
+	for(int d = maxDepth; d > 1; --d) {
+		std::vector<std::vector<TreeOctNode*> > ancestors(d - 1);
+		for(size_t i = 0; i != interior[d - 2].size(); ++i) {
+			TreeOctNode* node = interior[d - 2][i];
+			for(int c = 0; c != Cube::CORNERS; ++c)
+				if(node->child(c)->hasChildren() && (!newOnly || !IsSorted(node->child(c)->child(0)))) {
+					ancestors[d - 2].push_back(node);
+					break;
+				}
+		}
+		for(int e = d - 2; e > 0; --e) {
+			for(size_t i = 0; i != ancestors[e].size(); ++i)
+				ancestors[e - 1].push_back(ancestors[e][i]->parent());
+			std::sort(ancestors[e - 1].begin(), ancestors[e - 1].end());
+			ancestors[e - 1].erase(std::unique(ancestors[e - 1].begin(), ancestors[e - 1].end()),
+					ancestors[e - 1].end());
+		}
+
+		for(int e = 1; e <= d - 2; ++e) {
+			TreeNeighborKey3 neighborKey(maxDepth);
+#pragma omp parallel for num_threads(threads_) firstprivate(neighborKey)
+			for(int i = 0; i < (int)ancestors[e].size(); ++i) {
+				TreeOctNode* node = ancestors[e][i];
+				TreeNeighbors3& neighbors = neighborKey.getNeighbors3(node->parent());
+				int x;
+				int y;
+				int z;
+				Cube::FactorCornerIndex(node->parent()->childIndex(node), x, y, z);
+				for(int ii = x; ii <= x + 1; ++ii)
+					for(int jj = y; jj <= y + 1; ++jj)
+						for(int kk = z; kk <= z + 1; ++kk) {
+							TreeOctNode* neighbor = neighbors.at(ii, jj, kk);
+							if(neighbor && !neighbor->hasChildren())
+								parents[omp_get_thread_num()].push_back(neighbor);
+						}
 			}
-	refineBoundary(subdivideDepth);
+			InitChildren(parents, interior[e - 1]);
+		}
+
+		TreeNeighborKey3 neighborKey(maxDepth);
+#pragma omp parallel for num_threads(threads_) firstprivate(neighborKey)
+		for(int i = 0; i < (int)ancestors[d - 2].size(); ++i) {
+			TreeNeighbors3& neighbors = neighborKey.getNeighbors3(ancestors[d - 2][i]);
+			for(int ii = 0; ii != 3; ++ii)
+				for(int jj = 0; jj != 3; ++jj)
+					for(int kk = 0; kk != 3; ++kk) {
+						TreeOctNode* neighbor = neighbors.at(ii, jj, kk);
+						if(neighbor && !neighbor->hasChildren())
+							parents[omp_get_thread_num()].push_back(neighbor);
+					}
+		}
+		InitChildren(parents, interior[d - 2]);
+	}
+	refineBoundary(subdivideDepth, newOnly);
 }
 
 template<int Degree, bool OutputDensity>
@@ -1169,40 +1608,36 @@ CenterEvaluationStencils Octree<Degree, OutputDensity>::SetCenterEvaluationStenc
 		SetCenterEvaluationStencilsFunction(depth, center, evaluator));
 }
 
+// The taps of the parent's neighbors reach past the corner on the side of the parent away from the child
 template<int Degree, bool OutputDensity>
-CornerEvaluationStencil Octree<Degree, OutputDensity>::SetCornerEvaluationStencil(
-		CornerEvaluator2 const& evaluator, int depth) const {
-	if(depth < 2) return CornerEvaluationStencil();
-	int center = 1 << (depth - 1);
-	return SetStencil<double, 2, 3, SetCornerEvaluationStencilFunction>(
-		SetCornerEvaluationStencilFunction(depth, center, evaluator));
-}
-
-template<int Degree, bool OutputDensity>
-CornerEvaluationStencils Octree<Degree, OutputDensity>::SetCornerEvaluationStencils(
-		CornerEvaluator2 const& evaluator, int depth) const {
-	if(depth < 3) return CornerEvaluationStencils();
-	int center = 1 << (depth - 1);
-	return SetStencil<double, 2, 2, 3, SetCornerEvaluationStencilsFunction>(
-		SetCornerEvaluationStencilsFunction(depth, center, evaluator));
-}
-
-template<int Degree, bool OutputDensity>
-CornerNormalEvaluationStencil Octree<Degree, OutputDensity>::SetCornerNormalEvaluationStencil(
-		CornerEvaluator2 const& evaluator, int depth) const {
-	if(depth < 2) return CornerNormalEvaluationStencil();
-	int center = 1 << (depth - 1);
-	return SetStencil<Point3D<double>, 2, 5, SetCornerNormalEvaluationStencilFunction>(
-		SetCornerNormalEvaluationStencilFunction(depth, center, evaluator));
+template<int N>
+void Octree<Degree, OutputDensity>::SetCornerWeights(CornerEvaluator2 const& evaluator, int depth,
+		int const off[3], bool parent, bool derivatives, CornerWeights<N>& weights) const {
+	for(int a = 0; a != 3; ++a)
+		for(int c = 0; c != 2; ++c) {
+			for(int i = 0; i != N; ++i) {
+				int _off = (parent ? off[a] >> 1 : off[a]) + i - N / 2;
+				weights.dx[a][c][i] = evaluator.value(depth, off[a], c, _off, false, parent);
+				weights.ddx[a][c][i] = derivatives ? evaluator.value(depth, off[a], c, _off, true, parent) : 0;
+			}
+			weights.setRange(a, c, parent && c != (off[a] & 1));
+		}
 }
 
 template<int Degree, bool OutputDensity>
-CornerNormalEvaluationStencils Octree<Degree, OutputDensity>::SetCornerNormalEvaluationStencils(
-		CornerEvaluator2 const& evaluator, int depth) const {
-	if(depth < 3) return CornerNormalEvaluationStencils();
+template<int N>
+void Octree<Degree, OutputDensity>::SetCornerStencil(CornerEvaluator2 const& evaluator, int depth,
+		bool derivatives, CornerStencil<N>& stencil) const {
+	if(depth < 2) return;
 	int center = 1 << (depth - 1);
-	return SetStencil<Point3D<double>, 2, 2, 5, SetCornerNormalEvaluationStencilsFunction>(
-			SetCornerNormalEvaluationStencilsFunction(depth, center, evaluator));
+	int off[] = { center, center, center };
+	SetCornerWeights(evaluator, depth, off, false, derivatives, stencil.weights);
+	for(unsigned c = 0; c != Cube::CORNERS; ++c) {
+		int cOff[3];
+		Cube::FactorCornerIndex(c, cOff[0], cOff[1], cOff[2]);
+		for(int a = 0; a != 3; ++a) cOff[a] += center;
+		SetCornerWeights(evaluator, depth, cOff, true, derivatives, stencil.pWeights[c]);
+	}
 }
 
 template<int Degree, bool OutputDensity>
@@ -1281,13 +1716,15 @@ void Octree<Degree, OutputDensity>::UpdateConstraintsFromCoarser(TreeNeighbors5
 
 template<bool OutputDensity, class TreeOctNode, class F>
 void UpSampleGeneric(int depth, SortedTreeNodes<OutputDensity> const& sNodes, BoundaryType boundaryType,
-		int threads, F const& func) {
+		int threads, F const& func, std::vector<int> const* nodes = nullptr) {
 	double cornerValue = boundaryType == BoundaryTypeDirichlet ? 0.5 :
 		boundaryType == BoundaryTypeNeumann ? 1 : 0.75;
-	// For every node at the current depth
+	// For every node at the current depth, or only those listed
+	int count = nodes ? (int)nodes->size() : sNodes.nodeCount[depth + 1] - sNodes.nodeCount[depth];
 	typename TreeOctNode::NeighborKey3 neighborKey(depth);
 #pragma omp parallel for num_threads(threads) firstprivate(neighborKey)
-	for(int i = sNodes.nodeCount[depth]; i < sNodes.nodeCount[depth + 1]; ++i) {
+	for(int j = 0; j < count; ++j) {
+		int i = nodes ? (*nodes)[j] : sNodes.nodeCount[depth] + j;
 		int d;
 		int off[3];
 		sNodes.treeNodes[i]->depthAndOffset(d, off);
@@ -1334,20 +1771,20 @@ Vector<Real> Octree<Degree, OutputDensity>::UpSampleCoarserSolution(int depth,
 template<int Degree, bool OutputDensity>
 template<class C>
 void Octree<Degree, OutputDensity>::DownSample(int depth, SortedTreeNodes<OutputDensity> const& sNodes,
-		C* constraints) const {
+		C* constraints, std::vector<int> const* nodes) const {
 	if(depth == 0) return;
 	UpSampleGeneric<OutputDensity, TreeOctNode>(depth, sNodes, boundaryType_, threads_,
-		DownSampleFunction<C>(constraints));
+		DownSampleFunction<C>(constraints), nodes);
 }
 
 template<int Degree, bool OutputDensity>
 template<class C>
 void Octree<Degree, OutputDensity>::UpSample(int depth, SortedTreeNodes<OutputDensity> const& sNodes,
-		C* coefficients) const {
+		C* coefficients, std::vector<int> const* nodes) const {
 	if((boundaryType_ != BoundaryTypeNone && depth == 0) ||
 			(boundaryType_ == BoundaryTypeNone && depth <= 2)) return;
 	UpSampleGeneric<OutputDensity, TreeOctNode>(depth, sNodes, boundaryType_, threads_,
-		UpSample1Function<C>(coefficients));
+		UpSample1Function<C>(coefficients), nodes);
 }
 
 template<int Degree, bool OutputDensity>
@@ -1362,10 +1799,12 @@ void Octree<Degree, OutputDensity>::UpSample(int depth, SortedTreeNodes<OutputDe
 template<int Degree, bool OutputDensity>
 void Octree<Degree, OutputDensity>::SetCoarserPointValues(int depth,
 		SortedTreeNodes<OutputDensity> const& sNodes, Real* metSolution) {
+	std::vector<int> const* nodes;
+	int count = UpdatedNodes(depth, nodes);
 	TreeNeighborKey3 neighborKey(depth);
 #pragma omp parallel for num_threads(threads_) firstprivate(neighborKey)
-	for(int i = sNodes.nodeCount[depth]; i < sNodes.nodeCount[depth + 1]; ++i) {
-		TreeOctNode* node = sNodes.treeNodes[i];
+	for(int j = 0; j < count; ++j) {
+		TreeOctNode* node = sNodes.treeNodes[nodes ? (*nodes)[j] : sNodes.nodeCount[depth] + j];
 		if(node->nodeData.pointIndex != -1) {
 			neighborKey.getNeighbors3(node);
 			points_[node->nodeData.pointIndex].coarserValue =
@@ -1529,37 +1968,262 @@ int Octree<Degree, OutputDensity>::LaplacianMatrixIteration(int subdivideDepth,
 	return iter;
 }
 
+// Estimates the cost of reconstructing at depth (in the convention of the command line) from this tree,
+// set up and finalized at a coarser depth with the same minimum, kernel and divide depths. The points are
+// read (and merged) again and the depth each sample would be splatted at is found from the sample density
+// of this tree, then the refinement of the tree at the requested depth is replayed on the Morton keys of their cells,
+// taking a few bytes per node. The replay leaves out refineBoundary, so it is also run at the depth of
+// this tree, whose error against the nodes this tree has is reported and corrected for.
+// The solve time is modelled from the assembly of, and products with, one of the smaller systems of this
+// tree, using the iteration caps, so it errs high when the solver converges early. The memory model grows
+// the peak usage so far by the nodes and normals the finer tree holds more of, and adds the largest
+// transient allocations of the remaining stages. The mesh is given as the growth over the mesh of this tree.
+// Setting up the timed system writes over the constraints, so they have to be set again before solving.
 template<int Degree, bool OutputDensity>
-int Octree<Degree, OutputDensity>::SolveFixedDepthMatrix(int depth, Integrator const& integrator,
-		SortedTreeNodes<OutputDensity> const& sNodes, Real* metSolution, bool showResidual, int minIters,
-		double accuracy, bool noSolve, int fixedIters) {
-	Vector<Real> X(sNodes.nodeCount[depth + 1] - sNodes.nodeCount[depth]);
-	if(depth <= minDepth_) X = UpSampleCoarserSolution(depth, sNodes);
-	else {
-		// Up-sample the cumulative solution into the previous depth
-		UpSample(depth - 1, sNodes, metSolution);
-		// Add in the solution from that depth
-		if(depth)
-#pragma omp parallel for num_threads(threads_)
-			for(int i = sNodes_.nodeCount[depth - 1]; i < sNodes_.nodeCount[depth]; ++i)
-				metSolution[i] += sNodes_.treeNodes[i]->nodeData.solution;
+ReconstructionEstimate Octree<Degree, OutputDensity>::GetEstimate(std::string const& fileName,
+		XForm<Real, 4> const& xForm, int depth, int mergeDepth, int subdivideDepth, int minIters,
+		int maxSolveDepth, int fixedIters) {
+	ReconstructionEstimate estimate;
+	Integrator integrator;
+	fData_.setIntegrator(integrator, boundaryType_ == BoundaryTypeNone);
+	if(boundaryType_ == BoundaryTypeNone) {
+		++depth;
+		if(mergeDepth > 0) ++mergeDepth;
+		++subdivideDepth;
+		++maxSolveDepth;
 	}
-	double evaluateTime = 0;
-	if(constrainValues_) {
-		evaluateTime = Time();
-		SetCoarserPointValues(depth, sNodes, metSolution);
-		evaluateTime = Time() - evaluateTime;
+	int startDepth = boundaryType_ == BoundaryTypeNone ? 2 : 0;
+	int treeDepth = sNodes_.maxDepth - 1;
+	int drop = depth - treeDepth;
+	int fullDepth = std::min(minDepth_, treeDepth);
+	MemoryUsage();
+	double baseMemory = (double)maxMemoryUsage_;
+
+	// Count the nodes and the matrix entries (the same way GetFixedDepthLaplacianGeneric sizes the rows)
+	std::vector<double> nodes(treeDepth + 1, 0);
+	std::vector<double> entries(treeDepth + 1, 0);
+	double totalEntries = 0;
+	for(int d = startDepth; d <= treeDepth; ++d) {
+		long long count = 0;
+		TreeNeighborKey3 neighborKey3(d);
+#pragma omp parallel for num_threads(threads_) firstprivate(neighborKey3) reduction(+ : count)
+		for(int i = sNodes_.nodeCount[d]; i < sNodes_.nodeCount[d + 1]; ++i) {
+			TreeOctNode* node = sNodes_.treeNodes[i];
+			if(boundaryType_ != BoundaryTypeNone || IsInsetSupported(node))
+				count += GetMatrixRowSize(neighborKey3.getNeighbors5(node), true);
+			else ++count;
+		}
+		nodes[d] = sNodes_.nodeCount[d + 1] - sNodes_.nodeCount[d];
+		entries[d] = (double)count;
+		totalEntries += count;
 	}
 
-	double systemTime = Time();
-	// Get the system matrix
-	SparseSymmetricMatrix<Real> M = GetFixedDepthLaplacian(depth, integrator, sNodes, metSolution);
-	// Set the constraint vector
-	Vector<Real> B(sNodes.nodeCount[depth + 1] - sNodes.nodeCount[depth]);
-	for(int i = sNodes.nodeCount[depth]; i != sNodes.nodeCount[depth + 1]; ++i)
-		B[i - sNodes.nodeCount[depth]] =
-			boundaryType_ != BoundaryTypeNone || IsInsetSupported(sNodes.treeNodes[i]) ?
-			sNodes.treeNodes[i]->nodeData.constraint : 0;
+	// The cells the samples fall in at the requested depth and the depths they are splatted at
+	std::vector<unsigned long long> samples;
+	{
+		TreeConstNeighborKey3 neighborKey(treeDepth);
+		PointStream<Real>* pointStream = PointStream<Real>::open(fileName);
+		if(mergeDepth > 0) {
+			std::vector<MergedSample> merged;
+			MergeSamples(pointStream, xForm, std::min(mergeDepth, MORTON_KEY_BITS), merged);
+			for(size_t i = 0; i != merged.size(); ++i)
+				if(merged[i].count) samples.push_back(GetReplaySample(merged[i].position, depth, neighborKey));
+		} else {
+			XForm<Real, 3> xFormN = xForm.cut<3>().transpose().inverse();
+			Point3D<Real> p;
+			Point3D<Real> n;
+			while(pointStream->nextPoint(p, n)) {
+				p = (xForm * p - center_) / scale_;
+				n = xFormN * n;
+				if(inBounds(p) && Length(n) > EPSILON) samples.push_back(GetReplaySample(p, depth, neighborKey));
+			}
+		}
+		delete pointStream;
+	}
+
+	// Replay the refinement at the requested depth, then at the depth of this tree to check it
+	std::vector<std::vector<unsigned long long> > interior = GetInteriorCells(samples, depth);
+	std::vector<std::vector<unsigned long long> > treeInterior;
+	if(drop) {
+		for(size_t i = 0; i != samples.size(); ++i) {
+			int topDepth = (int)(samples[i] >> 1) & ((1 << (SAMPLE_DEPTH_BITS - 1)) - 1);
+			unsigned long long split = topDepth > treeDepth ? 0 : samples[i] & 1;
+			samples[i] = samples[i] >> SAMPLE_DEPTH_BITS >> 3 * drop << SAMPLE_DEPTH_BITS |
+					std::min(topDepth, treeDepth) << 1 | split;
+		}
+		treeInterior = GetInteriorCells(samples, treeDepth);
+	}
+	std::vector<unsigned long long>().swap(samples);
+	std::vector<double> replayed(treeDepth + 1, 0);
+	{
+		std::vector<std::vector<unsigned long long> > const& checked = drop ? treeInterior : interior;
+		double replayedNodes = 0;
+		double countedNodes = 0;
+		for(int d = fullDepth + 1; d <= treeDepth; ++d) {
+			replayed[d] = 8. * checked[d - 1].size();
+			replayedNodes += replayed[d];
+			countedNodes += nodes[d];
+		}
+		estimate.nodeError = countedNodes ? (replayedNodes - countedNodes) / countedNodes : 0;
+	}
+
+	// The nodes refineBoundary adds are made up for by the ratio of the counted nodes to the replayed ones,
+	// and the matrix entries per node are taken, at the depth of this tree as far from its finest one
+	std::vector<double> rows(depth + 1, 0);
+	std::vector<double> rowEntries(depth + 1, 0);
+	std::vector<double> rowBlocks(depth + 1, 1);
+	for(int d = startDepth; d <= depth; ++d) {
+		int r = d <= fullDepth ? d : std::max(std::min(d - drop, treeDepth), std::min(fullDepth + 1, treeDepth));
+		rows[d] = d <= minDepth_ ? std::pow(8., d) : 8. * interior[d - 1].size();
+		if(r > fullDepth && replayed[r]) rows[d] *= nodes[r] / replayed[r];
+		rowEntries[d] = nodes[r] ? rows[d] * entries[r] / nodes[r] : 0;
+		// The subdivided solver sweeps over the sub-trees that have nodes at the depth
+		if(subdivideDepth <= 0 || subdivideDepth >= d) continue;
+		int blockDepth = boundaryType_ == BoundaryTypeNone ? d - subdivideDepth + 1 : d - subdivideDepth;
+		if(d <= minDepth_) rowBlocks[d] = std::pow(8., blockDepth);
+		else if(blockDepth >= d) rowBlocks[d] = rows[d];
+		else {
+			int shift = 3 * (d - 1 - blockDepth);
+			std::vector<unsigned long long> const& cells = interior[d - 1];
+			rowBlocks[d] = 0;
+			for(size_t i = 0; i != cells.size(); ++i)
+				if(!i || cells[i] >> shift != cells[i - 1] >> shift) ++rowBlocks[d];
+		}
+	}
+	std::vector<std::vector<unsigned long long> >().swap(interior);
+	std::vector<std::vector<unsigned long long> >().swap(treeInterior);
+	double treeNodes = 0;
+	double nodeCount = 0;
+	for(int d = 0; d <= treeDepth; ++d)
+		treeNodes += d < startDepth ? (double)(sNodes_.nodeCount[d + 1] - sNodes_.nodeCount[d]) : nodes[d];
+	for(int d = 0; d <= depth; ++d) {
+		nodeCount += d < startDepth ? (double)(sNodes_.nodeCount[d + 1] - sNodes_.nodeCount[d]) : rows[d];
+		if(d < startDepth) continue;
+		estimate.nodes.push_back((long long)(rows[d] + 0.5));
+		estimate.entries.push_back((long long)(rowEntries[d] + 0.5));
+	}
+	baseMemory += (nodeCount - treeNodes) * (sizeof(TreeOctNode) + sizeof(TreeOctNode*)) +
+			normals_.size() * (nodeCount / treeNodes - 1) * sizeof(Point3D<Real>);
+
+	// Time the finest system of this tree that holds at most a sixteenth of its entries
+	int calibrationDepth = startDepth;
+	for(int d = startDepth; d <= treeDepth; ++d)
+		if(16 * entries[d] <= totalEntries) calibrationDepth = d;
+	std::vector<Real> metSolution(sNodes_.nodeCount[treeDepth], 0);
+	double rowTime;
+	double entryTime;
+	{
+		int rows = sNodes_.nodeCount[calibrationDepth + 1] - sNodes_.nodeCount[calibrationDepth];
+		double t = Time();
+		SparseSymmetricMatrix<Real> M = GetFixedDepthLaplacian(calibrationDepth, integrator, sNodes_,
+				&metSolution[0]);
+		rowTime = (Time() - t) / rows;
+		Vector<Real> B(rows);
+		Vector<Real> X(rows);
+		for(int i = 0; i != rows; ++i) B[i] = 1;
+		int iters = 0;
+		t = Time();
+		do iters += SparseSymmetricMatrix<Real>::Solve(M, B, 8, X, (Real)0, true, threads_, false);
+		while(Time() - t < 0.05);
+		// An iteration costs a product plus a few passes over the vectors
+		entryTime = (Time() - t) / iters / (M.Entries() + 2 * rows);
+	}
+
+	double matrixRowBytes = sizeof(std::vector<MatrixEntry<Real> >) + sizeof(int) + 5 * sizeof(Real);
+	double solveMemory = 0;
+	estimate.solveTime = 0;
+	for(int d = startDepth; d <= depth; ++d) {
+		double blocks = rowBlocks[d];
+		double overlap = 1;
+		if(subdivideDepth > 0 && subdivideDepth < d) {
+			// Each block's system also covers the two-ring around the sub-tree
+			double width = 1 << (boundaryType_ == BoundaryTypeNone ? subdivideDepth - 1 : subdivideDepth);
+			overlap = ((width + 4) / width) * ((width + 4) / width);
+		}
+		double blockRows = rows[d] / blocks * overlap;
+		double blockEntries = rowEntries[d] / blocks * overlap;
+		double iters = 0;
+		if(d <= maxSolveDepth)
+			iters = fixedIters >= 0 ? fixedIters : std::max((int)std::pow(blockRows, ITERATION_POWER), minIters);
+		estimate.solveTime += blocks * (blockRows * rowTime + iters * (blockEntries + 2 * blockRows) * entryTime);
+		solveMemory = std::max(solveMemory,
+				blockEntries * sizeof(MatrixEntry<Real>) + blockRows * matrixRowBytes + rows[d] * sizeof(Real));
+	}
+	solveMemory += nodeCount * sizeof(Real);
+
+	// The constraints and coefficients of SetLaplacianConstraints, and the corner and edge tables and the
+	// evaluated solution of GetMCIsoTriangles
+	double constraintMemory = nodeCount * (sizeof(Real) + sizeof(Point3D<Real>));
+	double extractionMemory = nodeCount * (sizeof(Real) + (Cube::CORNERS + Cube::EDGES) * sizeof(int));
+	estimate.peakMemory = baseMemory + std::max(solveMemory, std::max(constraintMemory, extractionMemory));
+
+	// The iso-surface is extracted from the leaves, which past the full depth hug the samples, so the mesh is
+	// taken to grow with the leaves finer than the full depth. The full depth stays the same with the tree.
+	double leaves = 0;
+	double treeLeaves = 0;
+	for(int d = minDepth_ + 1; d <= depth; ++d) leaves += rows[d] - (d < depth ? rows[d + 1] / 8 : 0);
+	for(int d = minDepth_ + 1; d <= treeDepth; ++d)
+		treeLeaves += nodes[d] - (d < treeDepth ? nodes[d + 1] / 8 : 0);
+	estimate.meshGrowth = treeLeaves ? leaves / treeLeaves : std::pow(4., drop);
+	return estimate;
+}
+
+template<int Degree, bool OutputDensity>
+int Octree<Degree, OutputDensity>::SolveFixedDepthMatrix(int depth, Integrator const& integrator,
+		SortedTreeNodes<OutputDensity> const& sNodes, Real* metSolution, bool showResidual, int minIters,
+		double accuracy, bool noSolve, int fixedIters) {
+	Vector<Real> X;
+	if(depth <= minDepth_ && !hasDirtyRegion_) X = UpSampleCoarserSolution(depth, sNodes);
+	if(depth > minDepth_) {
+		// Up-sample the cumulative solution into the previous depth
+		std::vector<int> const* nodes;
+		UpdatedNodes(depth - 1, nodes);
+		UpSample(depth - 1, sNodes, metSolution, nodes);
+		// Add in the solution from that depth
+		if(depth)
+#pragma omp parallel for num_threads(threads_)
+			for(int i = sNodes_.nodeCount[depth - 1]; i < sNodes_.nodeCount[depth]; ++i)
+				metSolution[i] += sNodes_.treeNodes[i]->nodeData.solution;
+	}
+	// After AppendPoints, the depths coarser than the dirty region keep their solution
+	if(hasDirtyRegion_ && depth < dirtyDepth_) return 0;
+	double evaluateTime = 0;
+	if(constrainValues_) {
+		evaluateTime = Time();
+		SetCoarserPointValues(depth, sNodes, metSolution);
+		evaluateTime = Time() - evaluateTime;
+	}
+
+	double systemTime = Time();
+	// After AppendPoints, the rows are those of the nodes that may be within two of a dirty one, which
+	// hold all the entries of the dirty rows, and the other nodes of the depth are left out of the matrix
+	std::vector<int> entries;
+	if(hasDirtyRegion_)
+		for(int i = sNodes.nodeCount[depth]; i != sNodes.nodeCount[depth + 1]; ++i) {
+			if(IsDirty(sNodes.treeNodes[i], 2)) entries.push_back(i);
+			sNodes.treeNodes[i]->nodeData.nodeIndex = -1;
+		}
+	// Get the system matrix
+	SparseSymmetricMatrix<Real> M = hasDirtyRegion_ ?
+		GetRestrictedFixedDepthLaplacian(depth, integrator, entries, (int)entries.size(), &tree_, 0, sNodes,
+				metSolution) :
+		GetFixedDepthLaplacian(depth, integrator, sNodes, metSolution);
+	if(hasDirtyRegion_)
+		for(int i = sNodes.nodeCount[depth]; i != sNodes.nodeCount[depth + 1]; ++i)
+			sNodes.treeNodes[i]->nodeData.nodeIndex = i;
+	std::vector<TreeOctNode*> rows(M.Rows());
+	for(int j = 0; j != M.Rows(); ++j)
+		rows[j] = sNodes.treeNodes[hasDirtyRegion_ ? entries[j] : sNodes.nodeCount[depth] + j];
+	// Set the constraint vector
+	Vector<Real> B(M.Rows());
+	for(int j = 0; j != M.Rows(); ++j)
+		B[j] = boundaryType_ != BoundaryTypeNone || IsInsetSupported(rows[j]) ?
+			rows[j]->nodeData.constraint : 0;
+	// Warm-start from the current solution, which is only non-zero when re-solving after AppendPoints
+	if(!X.Dimensions()) {
+		X = Vector<Real>(M.Rows());
+		for(int j = 0; j != M.Rows(); ++j) X[j] = rows[j]->nodeData.solution;
+	}
 	systemTime = Time() - systemTime;
 
 	double solveTime = Time();
@@ -1568,7 +2232,12 @@ int Octree<Degree, OutputDensity>::SolveFixedDepthMatrix(int depth, Integrator c
 	int res = 1 << depth;
 	if(boundaryType_ == BoundaryTypeNone && depth > 3) res -= 1 << (depth - 2);
 	int iter = 0;
-	if(!noSolve) {
+	if(!noSolve && hasDirtyRegion_) {
+		std::vector<char> dirty(M.Rows());
+#pragma omp parallel for num_threads(threads_)
+		for(int j = 0; j < M.Rows(); ++j) dirty[j] = IsDirty(rows[j]);
+		iter += SolveDirty(M, B, dirty, minIters, accuracy, fixedIters, X);
+	} else if(!noSolve) {
 		int iters = fixedIters >= 0 ? fixedIters :
 			std::max((int)std::pow(M.Rows(), ITERATION_POWER), minIters);
 		Real accuracy = fixedIters >= 0 ? 1e-10 : _accuracy;
@@ -1585,8 +2254,7 @@ int Octree<Degree, OutputDensity>::SolveFixedDepthMatrix(int depth, Integrator c
 	}
 
 	// Copy the solution back into the tree (over-writing the constraints)
-	for(int i = sNodes.nodeCount[depth]; i != sNodes.nodeCount[depth+1]; ++i)
-		sNodes.treeNodes[i]->nodeData.solution = X[i - sNodes.nodeCount[depth]];
+	for(int j = 0; j != M.Rows(); ++j) rows[j]->nodeData.solution = X[j];
 
 	DumpOutput::instance()("#\tEvaluated / Got / Solved in: %6.3f / %6.3f / %6.3f\t(%.3f MB)\n",
 			evaluateTime, systemTime, solveTime, (float)MemoryUsage());
@@ -1654,13 +2322,17 @@ int Octree<Degree, OutputDensity>::SolveFixedDepthMatrix(int depth, Integrator c
 
 	if(depth > minDepth_) {
 		// Up-sample the cumulative solution into the previous depth
-		UpSample(depth - 1, sNodes, metSolution);
+		std::vector<int> const* nodes;
+		UpdatedNodes(depth - 1, nodes);
+		UpSample(depth - 1, sNodes, metSolution, nodes);
 		// Add in the solution from that depth
 		if(depth)
 #pragma omp parallel for num_threads(threads_)
 			for(int i = sNodes_.nodeCount[depth - 1]; i < sNodes_.nodeCount[depth]; ++i)
 				metSolution[i] += sNodes_.treeNodes[i]->nodeData.solution;
 	}
+	// After AppendPoints, the depths coarser than the dirty region keep their solution
+	if(hasDirtyRegion_ && depth < dirtyDepth_) return 0;
 
 	double evaluateTime = 0;
 	if(constrainValues_) {
@@ -1680,14 +2352,20 @@ int Octree<Degree, OutputDensity>::SolveFixedDepthMatrix(int depth, Integrator c
 
 	int d = depth - startingDepth;
 	if(boundaryType_ == BoundaryTypeNone) ++d;
+	// The subtrees holding nodes that IsDirty
+	Point3D<Real> reach = Point3D<Real>::ones() * ((Real)(Degree + 1) / 2 / (1 << depth));
+	Point3D<Real> blockMin = dirtyMin_ - reach;
+	Point3D<Real> blockMax = dirtyMax_ + reach;
 	std::vector<int> subDimension;
 	int maxDimension = 0;
 	TreeNeighborKey3 neighborKey3(fData_.depth());
 	for(int i = sNodes.nodeCount[d]; i != sNodes.nodeCount[d + 1]; ++i) {
 		int adjacencyCount = 0;
-		getAdjacencyCount<TreeOctNode>(sNodes.treeNodes[i], neighborKey3, depth, fData_.depth(), width_,
-				SolveFixedDepthMatrix1Function<TreeOctNode>,
-				SolveFixedDepthMatrix2Function<TreeOctNode>(adjacencyCount));
+		// After AppendPoints, only the subtrees near the new samples are re-solved
+		if(!hasDirtyRegion_ || Intersects(sNodes.treeNodes[i], blockMin, blockMax))
+			getAdjacencyCount<TreeOctNode>(sNodes.treeNodes[i], neighborKey3, depth, fData_.depth(), width_,
+					SolveFixedDepthMatrix1Function<TreeOctNode>,
+					SolveFixedDepthMatrix2Function<TreeOctNode>(adjacencyCount));
 		subDimension.push_back(adjacencyCount);
 		maxDimension = std::max(maxDimension, adjacencyCount);
 	}
@@ -1733,7 +2411,11 @@ int Octree<Degree, OutputDensity>::SolveFixedDepthMatrix(int depth, Integrator c
 		// to correct it
 		time = Time();
 		Real _accuracy = (Real)(accuracy / 100000) * _M.Rows();
-		if(!noSolve) {
+		if(!noSolve && hasDirtyRegion_) {
+			std::vector<char> dirty(adjacencyCount2);
+			for(int j = 0; j < adjacencyCount2; ++j) dirty[j] = IsDirty(sNodes.treeNodes[adjacencies[j]]);
+			iter += SolveDirty(_M, _B, dirty, minIters, accuracy, fixedIters, _X);
+		} else if(!noSolve) {
 			int iters = fixedIters >= 0 ? fixedIters :
 				std::max((int)std::pow(_M.Rows(), ITERATION_POWER), minIters);
 			Real accuracy = fixedIters >= 0 ? 1e-10 : _accuracy;
@@ -1767,34 +2449,172 @@ int Octree<Degree, OutputDensity>::SolveFixedDepthMatrix(int depth, Integrator c
 	return tIter;
 }
 
+// Solves for the rows flagged dirty only, with the other entries of X held fixed
+template<int Degree, bool OutputDensity>
+int Octree<Degree, OutputDensity>::SolveDirty(SparseSymmetricMatrix<Real> const& M, Vector<Real> const& B,
+		std::vector<char> const& dirty, int minIters, double accuracy, int fixedIters, Vector<Real>& X) const {
+	std::vector<int> index(dirty.size(), -1);
+	int rows = 0;
+	for(size_t i = 0; i != dirty.size(); ++i)
+		if(dirty[i]) index[i] = rows++;
+	if(!rows) return 0;
+	SparseSymmetricMatrix<Real> _M;
+	Vector<Real> _B;
+	M.Restrict(index, rows, B, X, _M, _B);
+	Vector<Real> _X(rows);
+	for(size_t i = 0; i != index.size(); ++i)
+		if(index[i] >= 0) _X[index[i]] = X[i];
+	int iters = fixedIters >= 0 ? fixedIters : std::max((int)std::pow(rows, ITERATION_POWER), minIters);
+	Real _accuracy = fixedIters >= 0 ? 1e-10 : (Real)(accuracy / 100000) * rows;
+	int iter = SparseSymmetricMatrix<Real>::Solve(_M, _B, iters, _X, _accuracy, false, threads_, false);
+	for(size_t i = 0; i != index.size(); ++i)
+		if(index[i] >= 0) X[i] = _X[index[i]];
+	return iter;
+}
+
 template<int Degree, bool OutputDensity>
-bool Octree<Degree, OutputDensity>::HasNormals(TreeOctNode* node, Real epsilon) const {
-	if(node->nodeData.normalIndex >= 0 && (normals_[node->nodeData.normalIndex][0] != 0 ||
-				normals_[node->nodeData.normalIndex][1] != 0 ||
-				normals_[node->nodeData.normalIndex][2] != 0)) return true;
-	if(!node->hasChildren()) return false;
-	for(unsigned i = 0; i != Cube::CORNERS; ++i)
-		if(HasNormals(node->child(i), epsilon)) return true;
-	return false;
+bool Octree<Degree, OutputDensity>::HasNormal(TreeOctNode const* node) const {
+	int idx = node->nodeData.normalIndex;
+	return idx >= 0 && (normals_[idx][0] != 0 || normals_[idx][1] != 0 || normals_[idx][2] != 0);
 }
 
+// Drops the children of the nodes at or below the min depth when none of their subtrees holds a normal.
+// The nodes are listed breadth first, so that the children of a node are eight consecutive nodes of the
+// next depth, and whether each subtree holds a normal is found one depth at a time from the finest.
 template<int Degree, bool OutputDensity>
 void Octree<Degree, OutputDensity>::ClipTree() {
-	int maxDepth = tree_.maxDepth();
-	for(TreeOctNode* temp = tree_.nextNode(); temp; temp = tree_.nextNode(temp)) {
-		if(!temp->hasChildren() || temp->depth() < minDepth_) continue;
-		bool hasNormals = false;
-		for(unsigned i = 0; i != Cube::CORNERS; ++i) {
-			if(HasNormals(temp->child(i), EPSILON / (1 << maxDepth))) {
-				hasNormals = true;
-				break;
+	refinedSubdivideDepth_ = -1;
+	std::vector<std::vector<TreeOctNode*> > nodes(1, std::vector<TreeOctNode*>(1, &tree_));
+	std::vector<std::vector<int> > firstChild;
+	while(!nodes.back().empty()) {
+		std::vector<TreeOctNode*> const& parents = nodes.back();
+		firstChild.push_back(std::vector<int>(parents.size(), -1));
+		std::vector<TreeOctNode*> children;
+		for(size_t i = 0; i != parents.size(); ++i)
+			if(parents[i]->hasChildren()) {
+				firstChild.back()[i] = children.size();
+				for(int c = 0; c != Cube::CORNERS; ++c) children.push_back(parents[i]->child(c));
 			}
+		nodes.push_back(std::vector<TreeOctNode*>());
+		nodes.back().swap(children);
+	}
+
+	std::vector<char> hasNormals;
+	for(int d = (int)firstChild.size() - 1; d >= 0; --d) {
+		std::vector<char> parentHasNormals(nodes[d].size());
+#pragma omp parallel for num_threads(threads_)
+		for(int i = 0; i < (int)nodes[d].size(); ++i) {
+			int c = firstChild[d][i];
+			bool childHasNormals = false;
+			for(int j = 0; c >= 0 && j != Cube::CORNERS && !childHasNormals; ++j)
+				childHasNormals = hasNormals[c + j] != 0;
+			parentHasNormals[i] = childHasNormals || HasNormal(nodes[d][i]);
+			if(c >= 0 && !childHasNormals && nodes[d][i]->depth() >= minDepth_) nodes[d][i]->nullChildren();
 		}
-		if(!hasNormals) temp->nullChildren();
+		hasNormals.swap(parentHasNormals);
 	}
 	MemoryUsage();
 }
 
+// Drops the children of the node, none of which was sorted yet, and theirs, when it is at or below the
+// min depth and none of their subtrees holds a normal, as ClipTree does, and returns whether the subtree
+// of the node holds one
+template<int Degree, bool OutputDensity>
+bool Octree<Degree, OutputDensity>::ClipNewChildren(TreeOctNode* node) {
+	bool childHasNormals = false;
+	for(int c = 0; node->hasChildren() && c != Cube::CORNERS; ++c)
+		if(ClipNewChildren(node->child(c))) childHasNormals = true;
+	if(node->hasChildren() && !childHasNormals && node->depth() >= minDepth_) node->nullChildren();
+	return childHasNormals || HasNormal(node);
+}
+
+// Drops the nodes finer than depth so that the iso-surface is extracted from the solution truncated
+// to that depth. The dropped nodes stay with the allocator.
+template<int Degree, bool OutputDensity>
+void Octree<Degree, OutputDensity>::TruncateTree(int depth) {
+	if(boundaryType_ == BoundaryTypeNone) ++depth;
+	depth = std::max(depth, minDepth_);
+	for(TreeOctNode* node = tree_.nextNode(); node; node = tree_.nextNode(node))
+		if(node->depth() == depth && node->hasChildren()) node->nullChildren();
+	sNodes_.set(tree_);
+	refinedSubdivideDepth_ = -1;
+}
+
+// The box is given in the coordinates of the input points (before the transformation) and is
+// stored as the bounding box of its image in the unit cube.
+template<int Degree, bool OutputDensity>
+void Octree<Degree, OutputDensity>::SetRegionOfInterest(Point3D<Real> const& min, Point3D<Real> const& max,
+		XForm<Real, 4> xForm) {
+	hasRegionOfInterest_ = true;
+	for(unsigned c = 0; c != Cube::CORNERS; ++c) {
+		int x[3];
+		Cube::FactorCornerIndex(c, x[0], x[1], x[2]);
+		Point3D<Real> corner(x[0] ? max[0] : min[0], x[1] ? max[1] : min[1], x[2] ? max[2] : min[2]);
+		corner = (xForm * corner - center_) / scale_;
+		for(int i = 0; i != 3; ++i) {
+			if(!c || corner[i] < roiMin_[i]) roiMin_[i] = corner[i];
+			if(!c || corner[i] > roiMax_[i]) roiMax_[i] = corner[i];
+		}
+	}
+}
+
+template<int Degree, bool OutputDensity>
+bool Octree<Degree, OutputDensity>::Intersects(TreeOctNode const* node, Point3D<Real> const& min,
+		Point3D<Real> const& max) {
+	Point3D<Real> center;
+	Real width;
+	node->centerAndWidth(center, width);
+	for(int i = 0; i != 3; ++i)
+		if(center[i] + width / 2 < min[i] || center[i] - width / 2 > max[i]) return false;
+	return true;
+}
+
+// After AppendPoints, whether the node is re-solved: it is no coarser than dirtyDepth_ and its B-spline
+// reaches the dirty region. With a ring, whether it may be within that many nodes of one that is.
+template<int Degree, bool OutputDensity>
+bool Octree<Degree, OutputDensity>::IsDirty(TreeOctNode const* node, int ring) const {
+	if(node->depth() < dirtyDepth_) return false;
+	Point3D<Real> center;
+	Real width;
+	node->centerAndWidth(center, width);
+	Real reach = ((Real)(Degree + 1) / 2 + ring) * width;
+	for(int i = 0; i != 3; ++i)
+		if(center[i] + reach < dirtyMin_[i] || center[i] - reach > dirtyMax_[i]) return false;
+	return true;
+}
+
+// After AppendPoints, whether the constraints, the coarser values of the screening positions or the
+// cumulative solution set up at the node can reach those of the re-solved nodes. The B-splines of the
+// dirty nodes reach one and a half of their width out of the dirty region, and the nodes that the
+// constraints of those are gathered, down-sampled or up-sampled from overlap them, so four nodes of
+// either the node's or dirtyDepth_'s width are enough.
+template<int Degree, bool OutputDensity>
+bool Octree<Degree, OutputDensity>::IsNearDirty(TreeOctNode const* node) const {
+	Point3D<Real> center;
+	Real width;
+	node->centerAndWidth(center, width);
+	Real reach = 4 * (width + (Real)1 / (1 << dirtyDepth_));
+	for(int i = 0; i != 3; ++i)
+		if(center[i] + reach < dirtyMin_[i] || center[i] - reach > dirtyMax_[i]) return false;
+	return true;
+}
+
+// Whether the node was in the tree when the nodes were last sorted. The nodes added since have no index,
+// or that of the root once a normal is splatted into them.
+template<int Degree, bool OutputDensity>
+bool Octree<Degree, OutputDensity>::IsSorted(TreeOctNode const* node) const {
+	int idx = node->nodeData.nodeIndex;
+	return idx >= 0 && idx < sNodes_.nodeCount[sNodes_.maxDepth] && sNodes_.treeNodes[idx] == node;
+}
+
+// The number of nodes at the depth that setting the constraints and re-solving visit: after AppendPoints
+// those that IsNearDirty, whose indices are then listed in nodes, and otherwise all of them
+template<int Degree, bool OutputDensity>
+int Octree<Degree, OutputDensity>::UpdatedNodes(int depth, std::vector<int> const*& nodes) const {
+	nodes = hasDirtyRegion_ ? &nearDirty_[depth] : nullptr;
+	return nodes ? (int)nodes->size() : sNodes_.nodeCount[depth + 1] - sNodes_.nodeCount[depth];
+}
+
 template<int Degree, bool OutputDensity>
 void Octree<Degree, OutputDensity>::SetLaplacianConstraints() {
 	// To set the Laplacian constraints, we iterate over the
@@ -1804,21 +2624,29 @@ void Octree<Degree, OutputDensity>::SetLaplacianConstraints() {
 	// Coarser depths 
 	Integrator integrator;
 	fData_.setIntegrator(integrator, boundaryType_ == BoundaryTypeNone);
+	// After AppendPoints, only the nodes that IsNearDirty are visited, which is enough for the constraints
+	// of the re-solved nodes to come out as if all were
 	int maxDepth = sNodes_.maxDepth - 1;
 	std::vector<Real> constraints(sNodes_.nodeCount[maxDepth]);
 
 	// Clear the constraints
+	for(int d = 0; d <= maxDepth; ++d) {
+		std::vector<int> const* nodes;
+		int count = UpdatedNodes(d, nodes);
 #pragma omp parallel for num_threads(threads_)
-	for(int i = 0; i < sNodes_.nodeCount[maxDepth + 1]; ++i)
-		sNodes_.treeNodes[i]->nodeData.constraint = 0;
+		for(int j = 0; j < count; ++j)
+			sNodes_.treeNodes[nodes ? (*nodes)[j] : sNodes_.nodeCount[d] + j]->nodeData.constraint = 0;
+	}
 
 	for(int d = maxDepth; d >= (boundaryType_ == BoundaryTypeNone ? 2 : 0); --d) {
 		DivergenceStencil stencil = SetDivergenceStencil(d, integrator, false);
 		DivergenceStencils stencils = SetDivergenceStencils(d, integrator, true);
+		std::vector<int> const* nodes;
+		int count = UpdatedNodes(d, nodes);
 		TreeNeighborKey3 neighborKey3(fData_.depth());
 #pragma omp parallel for num_threads(threads_) firstprivate(neighborKey3)
-		for(int i = sNodes_.nodeCount[d]; i < sNodes_.nodeCount[d + 1]; ++i) {
-			TreeOctNode* node = sNodes_.treeNodes[i];
+		for(int j = 0; j < count; ++j) {
+			TreeOctNode* node = sNodes_.treeNodes[nodes ? (*nodes)[j] : sNodes_.nodeCount[d] + j];
 			Range3D range = Range3D::FullRange();
 			TreeNeighbors5 neighbors5 = neighborKey3.getNeighbors5(node);
 
@@ -1887,8 +2715,11 @@ void Octree<Degree, OutputDensity>::SetLaplacianConstraints() {
 	}
 	std::vector<Point3D<Real> > coefficients(sNodes_.nodeCount[maxDepth], Point3D<Real>());
 	for(int d = maxDepth - 1; d >= 0; --d) {
+		std::vector<int> const* nodes;
+		int count = UpdatedNodes(d, nodes);
 #pragma omp parallel for num_threads(threads_)
-		for(int i = sNodes_.nodeCount[d]; i < sNodes_.nodeCount[d + 1]; ++i) {
+		for(int j = 0; j < count; ++j) {
+			int i = nodes ? (*nodes)[j] : sNodes_.nodeCount[d] + j;
 			TreeOctNode* node = sNodes_.treeNodes[i];
 			if(node->nodeData.nodeIndex < 0 || node->nodeData.normalIndex < 0) continue;
 			coefficients[i] += normals_[node->nodeData.normalIndex];
@@ -1896,17 +2727,29 @@ void Octree<Degree, OutputDensity>::SetLaplacianConstraints() {
 	}
 
 	// Fine-to-coarse down-sampling of constraints
-	for(int d = maxDepth - 1; d >= (boundaryType_ == BoundaryTypeNone ? 2 : 0); --d)
-		DownSample(d, sNodes_, &constraints[0]);
+	for(int d = maxDepth - 1; d >= (boundaryType_ == BoundaryTypeNone ? 2 : 0); --d) {
+		std::vector<int> const* nodes;
+		UpdatedNodes(d, nodes);
+		DownSample(d, sNodes_, &constraints[0], nodes);
+	}
 
 	// Coarse-to-fine up-sampling of coefficients
-	for(int d = (boundaryType_ == BoundaryTypeNone ? 2 : 0); d < maxDepth; ++d)
-		UpSample(d, sNodes_, &coefficients[0]);
+	for(int d = (boundaryType_ == BoundaryTypeNone ? 2 : 0); d < maxDepth; ++d) {
+		std::vector<int> const* nodes;
+		UpdatedNodes(d, nodes);
+		UpSample(d, sNodes_, &coefficients[0], nodes);
+	}
 
 	// Add the accumulated constraints from all finer depths
+	for(int d = 0; d < maxDepth; ++d) {
+		std::vector<int> const* nodes;
+		int count = UpdatedNodes(d, nodes);
 #pragma omp parallel for num_threads(threads_)
-	for(int i = 0; i < sNodes_.nodeCount[maxDepth]; ++i)
-		sNodes_.treeNodes[i]->nodeData.constraint += constraints[i];
+		for(int j = 0; j < count; ++j) {
+			int i = nodes ? (*nodes)[j] : sNodes_.nodeCount[d] + j;
+			sNodes_.treeNodes[i]->nodeData.constraint += constraints[i];
+		}
+	}
 
 	constraints.clear();
 	shrink_to_fit(constraints);
@@ -1914,10 +2757,12 @@ void Octree<Degree, OutputDensity>::SetLaplacianConstraints() {
 	// Compute the contribution from all coarser depths
 	for(int d = 1; d <= maxDepth; ++d) {
 		DivergenceStencils stencils = SetDivergenceStencils(d, integrator, false);
+		std::vector<int> const* nodes;
+		int count = UpdatedNodes(d, nodes);
 		TreeNeighborKey3 neighborKey3(maxDepth);
 #pragma omp parallel for num_threads(threads_) firstprivate(neighborKey3)
-		for(int i = sNodes_.nodeCount[d]; i < sNodes_.nodeCount[d + 1]; ++i) {
-			TreeOctNode* node = sNodes_.treeNodes[i];
+		for(int j = 0; j < count; ++j) {
+			TreeOctNode* node = sNodes_.treeNodes[nodes ? (*nodes)[j] : sNodes_.nodeCount[d] + j];
 			int off[3];
 			node->depthAndOffset(d, off);
 			Range3D range = Range3D::FullRange();
@@ -1955,6 +2800,19 @@ void Octree<Degree, OutputDensity>::SetLaplacianConstraints() {
 		}
 	}
 
+	// The iso-surface extraction writes over the normal indices and, without density output, the density
+	// estimates are written over below, so keep both for AppendPoints
+	if(incremental_) {
+		int splatDepth = boundaryType_ == BoundaryTypeNone && splatDepth_ > 0 ? splatDepth_ + 1 : splatDepth_;
+		sampleNodes_.assign(normals_.size(), nullptr);
+		sampleDensities_.clear();
+		for(TreeOctNode* node = tree_.nextNode(); node; node = tree_.nextNode(node)) {
+			if(node->nodeData.normalIndex >= 0) sampleNodes_[node->nodeData.normalIndex] = node;
+			if(node->depth() <= splatDepth && node->nodeData.centerWeightContribution[0] != 0)
+				sampleDensities_.push_back(std::make_pair(node, node->nodeData.centerWeightContribution[0]));
+		}
+	}
+
 	// Set the point weights for evaluating the iso-value
 #pragma omp parallel for num_threads(threads_)
 	for(int i = 0; i < sNodes_.nodeCount[maxDepth + 1]; ++i) {
@@ -1964,7 +2822,7 @@ void Octree<Degree, OutputDensity>::SetLaplacianConstraints() {
 			Length(normals_[temp->nodeData.normalIndex]);
 	}
 	MemoryUsage();
-	normals_.clear();
+	if(!incremental_) normals_.clear();
 }
 
 template<int Degree, bool OutputDensity>
@@ -1995,8 +2853,53 @@ void Octree<Degree, OutputDensity>::FaceEdgesFunction::operator()(TreeOctNode co
 	}
 }
 
+// Sets the flags of the neighbors that the leaf needs across the boundary of its subtree at sDepth and
+// returns whether any is missing
+template<int Degree, bool OutputDensity>
+bool Octree<Degree, OutputDensity>::GetBoundaryRefinement(TreeOctNode* leaf, int sDepth,
+		TreeNeighborKey3& neighborKey, bool flags[3][3][3]) const {
+	int d;
+	int off[3];
+	leaf->depthAndOffset(d, off);
+	int res = (1 << d) - 1;
+	int _res = (1 << (d - sDepth)) - 1;
+	int _off[3] = { off[0] & _res, off[1] & _res, off[2] & _res };
+	bool boundary[3][2] = {
+		{ off[0] != 0 && _off[0] == 0, off[0] != res && _off[0] == _res },
+		{ off[1] != 0 && _off[1] == 0, off[1] != res && _off[1] == _res },
+		{ off[2] != 0 && _off[2] == 0, off[2] != res && _off[2] == _res },
+	};
+
+	if(!boundary[0][0] && !boundary[0][1] && !boundary[1][0] && !boundary[1][1] &&
+			!boundary[2][0] && !boundary[2][1]) return false;
+	TreeNeighbors3& neighbors = neighborKey.getNeighbors3(leaf);
+	int x = boundary[0][0] && !neighbors.at(0, 1, 1) ? -1 :
+		boundary[0][1] && !neighbors.at(2, 1, 1) ? 1 : 0;
+	int y = boundary[1][0] && !neighbors.at(1, 0, 1) ? -1 :
+		boundary[1][1] && !neighbors.at(1, 2, 1) ? 1 : 0;
+	int z = boundary[2][0] && !neighbors.at(1, 1, 0) ? -1 :
+		boundary[2][1] && !neighbors.at(1, 1, 2) ? 1 : 0;
+
+	if(!x && !y && !z) return false;
+	for(int i = 0; i != 3; ++i)
+		for(int j = 0; j != 3; ++j)
+			for(int k = 0; k != 3; ++k)
+				flags[i][j][k] = false;
+	// Corner case
+	if(x && y && z) flags[1 + x][1 + y][1 + z] = true;
+	// Edge cases
+	if(x && y) flags[1 + x][1 + y][1] = true;
+	if(x && z) flags[1 + x][1][1 + z] = true;
+	if(y && z) flags[1][1 + y][1 + z] = true;
+	// Face cases
+	if(x) flags[1 + x][1][1] = true;
+	if(y) flags[1][1 + y][1] = true;
+	if(z) flags[1][1][1 + z] = true;
+	return true;
+}
+
 template<int Degree, bool OutputDensity>
-int Octree<Degree, OutputDensity>::refineBoundary(int subdivideDepth) {
+int Octree<Degree, OutputDensity>::refineBoundary(int subdivideDepth, bool newOnly) {
 	// This implementation is somewhat tricky.
 	// We would like to ensure that leaf-nodes across a subdivision boundary have the same depth.
 	// We do this by calling the setNeighbors function.
@@ -2011,57 +2914,117 @@ int Octree<Degree, OutputDensity>::refineBoundary(int subdivideDepth) {
 	subdivideDepth = std::min(subdivideDepth, maxDepth);
 	int sDepth = maxDepth - subdivideDepth;
 	if(boundaryType_ == BoundaryTypeNone) sDepth = std::max(2, sDepth);
+	// The refinement is idempotent, so the tree and the sorted nodes are still valid if it has not
+	// changed since the last call
+	if(refinedSubdivideDepth_ == subdivideDepth) return sDepth;
+	refinedSubdivideDepth_ = subdivideDepth;
 	if(sDepth == 0) {
 		sNodes_.set(tree_);
 		return sDepth;
 	}
 
 	// Ensure that face adjacent neighbors across the subdivision boundary exist to allow for
-	// a consistent definition of the iso-surface
+	// a consistent definition of the iso-surface. The leaves missing such neighbors are found in
+	// parallel over the subtrees, then refined in order, checking again the neighbors that an earlier
+	// refinement may have added. The leaves a refinement creates may need refining in turn, so this is
+	// repeated until no leaf does. With newOnly, the boundary was refined for the same subdivision depth
+	// before any node was added since the nodes were last sorted, and the old leaves still have their
+	// neighbors, so only the added leaves are checked.
+	std::vector<TreeOctNode*> subtrees;
+	for(TreeOctNode* node = tree_.nextNode(); node; node = tree_.nextNode(node))
+		if(node->depth() == sDepth) subtrees.push_back(node);
+	std::vector<std::vector<TreeOctNode*> > leaves(subtrees.size());
 	TreeNeighborKey3 nKey(maxDepth);
-	for(TreeOctNode* leaf = tree_.nextLeaf(); leaf; leaf = tree_.nextLeaf(leaf)) {
-		if(leaf->depth() <= sDepth) continue;
-		int d;
-		int off[3];
-		leaf->depthAndOffset(d, off);
-		int res = (1 << d) - 1;
-		int _res = (1 << (d - sDepth)) - 1;
-		int _off[3] = { off[0] & _res, off[1] & _res, off[2] & _res };
-		bool boundary[3][2] = {
-			{ off[0] != 0 && _off[0] == 0, off[0] != res && _off[0] == _res },
-			{ off[1] != 0 && _off[1] == 0, off[1] != res && _off[1] == _res },
-			{ off[2] != 0 && _off[2] == 0, off[2] != res && _off[2] == _res },
-		};
-
-		if(!boundary[0][0] && !boundary[0][1] && !boundary[1][0] && !boundary[1][1] &&
-				!boundary[2][0] && !boundary[2][1]) continue;
-		TreeNeighbors3& neighbors = nKey.getNeighbors3(leaf);
-		int x = boundary[0][0] && !neighbors.at(0, 1, 1) ? -1 :
-			boundary[0][1] && !neighbors.at(2, 1, 1) ? 1 : 0;
-		int y = boundary[1][0] && !neighbors.at(1, 0, 1) ? -1 :
-			boundary[1][1] && !neighbors.at(1, 2, 1) ? 1 : 0;
-		int z = boundary[2][0] && !neighbors.at(1, 1, 0) ? -1 :
-			boundary[2][1] && !neighbors.at(1, 1, 2) ? 1 : 0;
-
-		if(!x && !y && !z) continue;
-		bool flags[3][3][3] = {};
-		// Corner case
-		if(x && y && z) flags[1 + x][1 + y][1 + z] = true;
-		// Edge cases
-		if(x && y) flags[1 + x][1 + y][1] = true;
-		if(x && z) flags[1 + x][1][1 + z] = true;
-		if(y && z) flags[1][1 + y][1 + 1] = true; // TODO: maybe 1 + z?
-		// Face cases
-		if(x) flags[1 + x][1][1] = true;
-		if(y) flags[1][1 + y][1] = true;
-		if(z) flags[1][1][1 + z] = true;
-		nKey.setNeighbors(leaf, flags);
+	for(bool refined = true; refined;) {
+		refined = false;
+#pragma omp parallel for num_threads(threads_) firstprivate(nKey) schedule(dynamic)
+		for(int i = 0; i < (int)subtrees.size(); ++i) {
+			bool flags[3][3][3];
+			leaves[i].clear();
+			for(TreeOctNode* leaf = subtrees[i]->nextLeaf(); leaf; leaf = subtrees[i]->nextLeaf(leaf))
+				if(leaf->depth() > sDepth && (!newOnly || !IsSorted(leaf)) &&
+						GetBoundaryRefinement(leaf, sDepth, nKey, flags))
+					leaves[i].push_back(leaf);
+		}
+		for(size_t i = 0; i != leaves.size(); ++i)
+			for(size_t j = 0; j != leaves[i].size(); ++j) {
+				bool flags[3][3][3];
+				if(!GetBoundaryRefinement(leaves[i][j], sDepth, nKey, flags)) continue;
+				nKey.setNeighbors(leaves[i][j], flags);
+				refined = true;
+			}
+		nKey = TreeNeighborKey3(maxDepth);
 	}
 	sNodes_.set(tree_);
 	MemoryUsage();
 	return sDepth;
 }
 
+// Sets the flags of the leaves intersecting the region of interest to 2. The leaves touching them
+// are set to 1, as are the ancestors of all of those. The iso-surface is only triangulated in the
+// former, but the latter are needed for the corner values and roots on the shared faces.
+template<int Degree, bool OutputDensity>
+void Octree<Degree, OutputDensity>::SetRegionOfInterestFlags(std::vector<char>& flags) const {
+	flags.assign(sNodes_.nodeCount[sNodes_.maxDepth], 0);
+	// The re-solved B-splines are no wider than Degree + 1 cells of dirtyDepth_ and reach the dirty region,
+	// so the function only changes that far out of it
+	Point3D<Real> changed = Point3D<Real>::ones() * ((Real)(Degree + 1) / (1 << dirtyDepth_));
+	Point3D<Real> changedMin = dirtyMin_ - changed;
+	Point3D<Real> changedMax = dirtyMax_ + changed;
+	Point3D<Real> roiMin = hasRegionOfInterest_ ? roiMin_ : changedMin;
+	Point3D<Real> roiMax = hasRegionOfInterest_ ? roiMax_ : changedMax;
+	if(hasRegionOfInterest_ && hasDirtyRegion_)
+		for(int i = 0; i != 3; ++i) {
+			roiMin[i] = std::max(roiMin[i], changedMin[i]);
+			roiMax[i] = std::min(roiMax[i], changedMax[i]);
+		}
+	std::vector<TreeOctNode const*> leaves;
+	std::vector<TreeOctNode const*> stack(1, &tree_);
+	while(!stack.empty()) {
+		TreeOctNode const* node = stack.back();
+		stack.pop_back();
+		if(!Intersects(node, roiMin, roiMax)) continue;
+		if(node->hasChildren())
+			for(unsigned c = 0; c != Cube::CORNERS; ++c) stack.push_back(node->child(c));
+		else if(node->nodeData.nodeIndex >= 0) {
+			flags[node->nodeData.nodeIndex] = 2;
+			leaves.push_back(node);
+		}
+	}
+
+	size_t coreCount = leaves.size();
+	TreeConstNeighborKey3 nKey(tree_.maxDepth());
+	for(size_t i = 0; i != coreCount; ++i) {
+		Point3D<Real> center;
+		Real width;
+		leaves[i]->centerAndWidth(center, width);
+		Point3D<Real> min = center - Point3D<Real>::ones() * (width / 2);
+		Point3D<Real> max = center + Point3D<Real>::ones() * (width / 2);
+		TreeConstNeighbors3 const& neighbors = nKey.getNeighbors3(leaves[i]);
+		for(int j = 0; j != 3 * 3 * 3; ++j) {
+			TreeOctNode const* neighbor = neighbors.at(j / 9, (j / 3) % 3, j % 3);
+			if(!neighbor || !neighbor->hasChildren()) continue;
+			stack.push_back(neighbor);
+			while(!stack.empty()) {
+				TreeOctNode const* node = stack.back();
+				stack.pop_back();
+				if(!Intersects(node, min, max)) continue;
+				if(node->hasChildren())
+					for(unsigned c = 0; c != Cube::CORNERS; ++c) stack.push_back(node->child(c));
+				else if(node->nodeData.nodeIndex >= 0 && !flags[node->nodeData.nodeIndex]) {
+					flags[node->nodeData.nodeIndex] = 1;
+					leaves.push_back(node);
+				}
+			}
+		}
+	}
+
+	for(size_t i = 0; i != leaves.size(); ++i)
+		for(TreeOctNode const* node = leaves[i]->parent();
+				node && !flags[node->nodeData.nodeIndex]; node = node->parent())
+			flags[node->nodeData.nodeIndex] = 1;
+}
+
 template<int Degree, bool OutputDensity>
 template<class Vertex>
 void Octree<Degree, OutputDensity>::GetMCIsoTriangles(Real isoValue, int subdivideDepth,
@@ -2079,6 +3042,12 @@ void Octree<Degree, OutputDensity>::GetMCIsoTriangles(Real isoValue, int subdivi
 		metSolution[i] = sNodes_.treeNodes[i]->nodeData.solution;
 	for(int d = minDepth_; d < maxDepth; ++d) UpSample(d, sNodes_, &metSolution[0]);
 
+	// Nodes flagged 0 are skipped, 1 are evaluated and 2 are also triangulated
+	// The extraction is restricted to the region of interest and, after AppendPoints, to the dirty region
+	bool restricted = hasRegionOfInterest_ || hasDirtyRegion_;
+	std::vector<char> roiFlags;
+	if(restricted) SetRegionOfInterestFlags(roiFlags);
+
 	// Clear the marching cube indices
 #pragma omp parallel for num_threads( threads_ )
 	for(int i = 0; i < sNodes_.nodeCount[maxDepth + 1]; ++i)
@@ -2086,16 +3055,32 @@ void Octree<Degree, OutputDensity>::GetMCIsoTriangles(Real isoValue, int subdivi
 
 	int offSet = 0;
 
-	int maxCCount = sNodes_.getMaxCornerCount(sDepth, maxDepth, threads_);
-	int maxECount = sNodes_.getMaxEdgeCount(&tree_, sDepth, threads_);
+	// The corners and edges each node owns in its subtree, shared by the tables of all the subtrees, and
+	// the exact counts of each subtree
+	std::vector<unsigned char> cornerOwners;
+	std::vector<unsigned short> edgeOwners;
+	sNodes_.getCornerOwners(sDepth, maxDepth, threads_, cornerOwners);
+	sNodes_.getEdgeOwners(sDepth, threads_, edgeOwners);
+	std::vector<std::vector<std::pair<int, int> > > spans;
+	sNodes_.getSubtreeSpans(sDepth, spans, threads_);
+	std::vector<int> cCounts;
+	std::vector<int> eCounts;
+	sNodes_.getSubtreeCounts(sDepth, spans, cornerOwners, cCounts, threads_);
+	sNodes_.getSubtreeCounts(sDepth, spans, edgeOwners, eCounts, threads_);
+	int maxCCount = 0;
+	int maxECount = 0;
+	for(size_t k = 0; k != cCounts.size(); ++k) {
+		maxCCount = std::max(maxCCount, cCounts[k]);
+		maxECount = std::max(maxECount, eCounts[k]);
+	}
 
 	RootData<OutputDensity> rootData;
-	rootData.cornerValues.resize(maxCCount);
-	rootData.cornerNormals.resize(maxCCount);
-	rootData.interiorRoots.resize(maxECount);
-	rootData.cornerValuesSet.resize(maxCCount);
-	rootData.cornerNormalsSet.resize(maxCCount);
-	rootData.edgesSet.resize(maxECount);
+	rootData.cornerValues.reserve(maxCCount);
+	rootData.cornerNormals.reserve(maxCCount);
+	rootData.interiorRoots.reserve(maxECount);
+	rootData.cornerValuesSet.reserve(maxCCount);
+	rootData.cornerNormalsSet.reserve(maxCCount);
+	rootData.edgesSet.reserve(maxECount);
 	RootData<OutputDensity> coarseRootData;
 	sNodes_.setCornerTable(coarseRootData, nullptr, sDepth, threads_);
 	coarseRootData.cornerValues.resize(coarseRootData.cCount());
@@ -2105,40 +3090,68 @@ void Octree<Degree, OutputDensity>::GetMCIsoTriangles(Real isoValue, int subdivi
 	MemoryUsage();
 
 	TreeConstNeighborKey3 nKey(maxDepth);
+	MinimalAreaTriangulation<Real> MAT;
+	std::vector<int> rootSlots;
+	std::vector<char> cornersNeeded;
 	std::vector<CornerValueStencil> vStencils(maxDepth + 1);
 	std::vector<CornerNormalStencil> nStencils(maxDepth + 1);
 	for(int d = minDepth_; d <= maxDepth; ++d) {
-		vStencils[d].stencil = SetCornerEvaluationStencil(evaluator, d);
-		vStencils[d].stencils = SetCornerEvaluationStencils(evaluator, d);
-		nStencils[d].stencil = SetCornerNormalEvaluationStencil(evaluator, d);
-		nStencils[d].stencils = SetCornerNormalEvaluationStencils(evaluator, d);
+		SetCornerStencil(evaluator, d, false, vStencils[d]);
+		SetCornerStencil(evaluator, d, true, nStencils[d]);
 	}
 
 	// First process all leaf nodes at depths strictly finer than sDepth, one subtree at a time.
 	for(int i = sNodes_.nodeCount[sDepth]; i != sNodes_.nodeCount[sDepth + 1]; ++i) {
 		if(!sNodes_.treeNodes[i]->hasChildren()) continue;
+		if(restricted && !roiFlags[i]) continue;
 
-		sNodes_.setCornerTable(rootData, sNodes_.treeNodes[i], threads_);
-		sNodes_.setEdgeTable(rootData, sNodes_.treeNodes[i], threads_);
+		sNodes_.setCornerTable(rootData, sNodes_.treeNodes[i], threads_, &cornerOwners[0]);
+		sNodes_.setEdgeTable(rootData, sNodes_.treeNodes[i], threads_, &edgeOwners[0]);
+		rootData.cornerValues.resize(rootData.cCount());
+		rootData.cornerNormals.resize(rootData.cCount());
+		rootData.interiorRoots.resize(rootData.eCount());
 		rootData.cornerValuesSet.assign(rootData.cCount(), 0);
 		rootData.cornerNormalsSet.assign(rootData.cCount(), 0);
 		rootData.edgesSet.assign(rootData.eCount(), 0);
+		// When restricted, the corners of the leaves in the region, which their owners evaluate even if
+		// outside of it
+		if(restricted) {
+			cornersNeeded.assign(rootData.cCount(), 0);
+			for(int d = maxDepth; d > sDepth; --d) {
+				std::pair<int, int> span = spans[d][i - sNodes_.nodeCount[sDepth]];
+				for(int j = span.first; j < span.second; ++j) {
+					if(sNodes_.treeNodes[j]->hasChildren() || !roiFlags[j]) continue;
+					for(unsigned c = 0; c != Cube::CORNERS; ++c)
+						cornersNeeded[rootData.cornerIndices(sNodes_.treeNodes[j], c)] = 1;
+				}
+			}
+		}
 		std::vector<Vertex> interiorVertices;
 		for(int d = maxDepth; d > sDepth; --d) {
-			std::vector<TreeOctNode*> leafNodes;
-			for(TreeOctNode* node = sNodes_.treeNodes[i]->nextLeaf(); node;
-					node = sNodes_.treeNodes[i]->nextLeaf(node))
-				if(node->depth() == d && node->nodeData.nodeIndex != -1)
-					leafNodes.push_back(node);
-			size_t leafNodeCount = leafNodes.size();
+			std::pair<int, int> span = spans[d][i - sNodes_.nodeCount[sDepth]];
+			rootSlots.assign((span.second - span.first) * Cube::EDGES, -1);
 
-			// First set the corner values and associated marching-cube indices
+			// First evaluate the corners owned by the leaves. The owners are the finest leaves around a
+			// corner, so the coarser leaves find the values they share with finer ones already set.
+#pragma omp parallel for num_threads(threads_) firstprivate(nKey)
+			for(int j = span.first; j < span.second; ++j) {
+				TreeOctNode const* leaf = sNodes_.treeNodes[j];
+				if(leaf->hasChildren()) continue;
+				unsigned char owned = cornerOwners[j];
+				if(restricted && !roiFlags[j])
+					for(unsigned c = 0; c != Cube::CORNERS; ++c)
+						if(!cornersNeeded[rootData.cornerIndices(leaf, c)]) owned &= ~(1 << c);
+				SetOwnedCornerValues(leaf, owned, rootData, &rootData.cornerValuesSet[0],
+						&rootData.cornerValues[0], nKey, metSolution, evaluator, vStencils[d]);
+			}
+
+			// Then set the associated marching-cube indices, with all the corners of the leaves set
 #pragma omp parallel for num_threads(threads_) firstprivate(nKey)
-			for(int j = 0; j < (int)leafNodeCount; ++j) {
-				TreeOctNode* leaf = leafNodes[j];
+			for(int j = span.first; j < span.second; ++j) {
+				TreeOctNode* leaf = sNodes_.treeNodes[j];
+				if(leaf->hasChildren() || (restricted && !roiFlags[j])) continue;
 				SetIsoCorners(isoValue, leaf, rootData, &rootData.cornerValuesSet[0],
-						&rootData.cornerValues[0], nKey, metSolution, evaluator, vStencils[d].stencil,
-						vStencils[d].stencils);
+						&rootData.cornerValues[0], nKey, metSolution, evaluator, vStencils[d]);
 
 				// If this node shares a vertex with a coarser node, set the vertex value
 				int d;
@@ -2161,23 +3174,48 @@ void Octree<Degree, OutputDensity>::GetMCIsoTriangles(Real isoValue, int subdivi
 					coarseRootData.cornerValuesSet[idx] = true;
 				}
 
-				// Compute the iso-vertices
-				//
+				// Compute the iso-vertices on the boundary of the subtree and find the interior ones
 				if(boundaryType_ != BoundaryTypeNone || IsInset(leaf))
-					SetMCRootPositions(leaf, sDepth, isoValue, nKey, rootData, &interiorVertices, mesh,
-							metSolution, evaluator, nStencils[d].stencil, nStencils[d].stencils,
-							nonLinearFit);
+					SetMCRootPositions(leaf, sDepth, isoValue, nKey, rootData,
+							&rootSlots[(j - span.first) * Cube::EDGES], mesh, metSolution, evaluator,
+							nStencils[d], nonLinearFit);
 			}
-			// Note that this should be broken off for multi-threading as
-			// the SetMCRootPositions writes to interiorPoints (with locking)
-			// while GetMCIsoTriangles reads from interiorPoints (without locking)
-			std::vector<Vertex> barycenters;
+
+			// The first leaf, in sorted order, to find an interior root owns it and the next out-of-core index.
+			// The others drop their slot, so the roots are computed once each, without locking, and written
+			// in the same order for any number of threads.
+			size_t vCount = interiorVertices.size();
+			for(int j = span.first; j < span.second; ++j) {
+				int* slots = &rootSlots[(j - span.first) * Cube::EDGES];
+				for(int o = 0; o != DIMENSION; ++o)
+					for(int a = 0; a != 2; ++a)
+						for(int b = 0; b != 2; ++b) {
+							int& slot = slots[Cube::EdgeIndex(o, a, b)];
+							if(slot < 0) continue;
+							if(rootData.edgesSet[slot]) slot = -1;
+							else {
+								rootData.edgesSet[slot] = 1;
+								rootData.interiorRoots[slot] = offSet + (int)vCount++;
+							}
+						}
+			}
+			size_t start = interiorVertices.size();
+			interiorVertices.resize(vCount);
 #pragma omp parallel for num_threads(threads_) firstprivate(nKey)
-			for(int i = 0; i < (int)leafNodeCount; ++i) {
-				TreeOctNode* leaf = leafNodes[i];
+			for(int j = span.first; j < span.second; ++j)
+				SetMCInteriorRoots(sNodes_.treeNodes[j], sDepth, isoValue, nKey, rootData,
+						&rootSlots[(j - span.first) * Cube::EDGES], interiorVertices, offSet, metSolution,
+						evaluator, nStencils[d], nonLinearFit);
+			for(size_t k = start; k != vCount; ++k) mesh->addOutOfCorePoint(interiorVertices[k]);
+
+			std::vector<Vertex> barycenters;
+#pragma omp parallel for num_threads(threads_) firstprivate(nKey, MAT)
+			for(int j = span.first; j < span.second; ++j) {
+				TreeOctNode* leaf = sNodes_.treeNodes[j];
+				if(leaf->hasChildren() || (restricted && roiFlags[j] != 2)) continue;
 				if(boundaryType_ != BoundaryTypeNone || IsInset(leaf))
 					GetMCIsoTriangles(leaf, nKey, mesh, rootData, &interiorVertices, offSet, sDepth,
-							polygonMesh, addBarycenter ? &barycenters : nullptr);
+							polygonMesh, addBarycenter ? &barycenters : nullptr, MAT);
 			}
 			for(size_t i = 0; i != barycenters.size(); ++i) interiorVertices.push_back(barycenters[i]);
 		}
@@ -2207,18 +3245,19 @@ void Octree<Degree, OutputDensity>::GetMCIsoTriangles(Real isoValue, int subdivi
 		for(int i = sNodes_.nodeCount[d]; i != sNodes_.nodeCount[d + 1]; ++i) {
 			TreeOctNode* leaf = sNodes_.treeNodes[i];
 			if(leaf->hasChildren()) continue;
+			if(restricted && !roiFlags[i]) continue;
 
 			// First set the corner values and associated marching-cube indices
 			SetIsoCorners(isoValue, leaf, coarseRootData, &coarseRootData.cornerValuesSet[0],
-					&coarseRootData.cornerValues[0], nKey, metSolution, evaluator, vStencils[d].stencil,
-					vStencils[d].stencils);
+					&coarseRootData.cornerValues[0], nKey, metSolution, evaluator, vStencils[d]);
 
 			// Now compute the iso-vertices
 			if(boundaryType_ != BoundaryTypeNone || IsInset(leaf)) {
 				SetMCRootPositions<Vertex>(leaf, 0, isoValue, nKey, coarseRootData, nullptr, mesh,
-						metSolution, evaluator, nStencils[d].stencil, nStencils[d].stencils, nonLinearFit);
-				GetMCIsoTriangles<Vertex>(leaf, nKey, mesh, coarseRootData, nullptr, 0, 0, polygonMesh,
-						addBarycenter ? &barycenters : nullptr);
+						metSolution, evaluator, nStencils[d], nonLinearFit);
+				if(!restricted || roiFlags[i] == 2)
+					GetMCIsoTriangles<Vertex>(leaf, nKey, mesh, coarseRootData, nullptr, 0, 0, polygonMesh,
+							addBarycenter ? &barycenters : nullptr, MAT);
 			}
 		}
 	}
@@ -2295,218 +3334,93 @@ Real Octree<Degree, OutputDensity>::getCenterValue(TreeConstNeighborKey3 const&
 	return value;
 }
 
-// TODO: Looks very similar to getCenterValue.
+// The corners are evaluated from the coefficients of the 3x3x3 neighbors of the node and of its parent,
+// gathered once for all of them. Interior nodes take the weights of their depth, the others set their own.
 template<int Degree, bool OutputDensity>
-Real Octree<Degree, OutputDensity>::getCornerValue(TreeConstNeighborKey3 const& neighborKey3,
-		TreeOctNode const* node, int corner, std::vector<Real> const& metSolution,
-		CornerEvaluator2 const& evaluator, Stencil<double, 3> const& stencil,
-		CornerEvaluationStencil const& stencils, bool isInterior) const {
-	double value = boundaryType_ == BoundaryTypeDirichlet ? -0.5 : 0;
+void Octree<Degree, OutputDensity>::getCornerValues(TreeConstNeighborKey3 const& neighborKey3,
+		TreeOctNode const* node, unsigned char corners, std::vector<Real> const& metSolution,
+		CornerEvaluator2 const& evaluator, CornerValueStencil const& stencil, bool isInterior,
+		Real values[8]) const {
+	double v[Cube::CORNERS];
+	for(unsigned c = 0; c != Cube::CORNERS; ++c) v[c] = boundaryType_ == BoundaryTypeDirichlet ? -0.5 : 0;
 	int d;
 	int off[3];
 	node->depthAndOffset(d, off);
 
-	int cx;
-	int cy;
-	int cz;
-	Range3D range;
-	range.xStart = range.yStart = range.zStart = 0;
-	range.xEnd = range.yEnd = range.zEnd = 3;
-	Cube::FactorCornerIndex(corner, cx, cy, cz);
+	double s[3][3][3];
+	CornerWeights<3> weights;
 	TreeConstNeighbors3 const& neighbors = neighborKey3.neighbors(d);
-	if(cx == 0) range.xEnd = 2;
-	else range.xStart = 1;
-	if(cy == 0) range.yEnd = 2;
-	else range.yStart = 1;
-	if(cz == 0) range.zEnd = 2;
-	else range.zStart = 1;
-	if(isInterior) {
-		for(int x = range.xStart; x != range.xEnd; ++x) {
-			for(int y = range.yStart; y != range.yEnd; ++y) {
-				for(int z = range.zStart; z != range.zEnd; ++z) {
-					TreeOctNode const* _node = neighbors.at(x, y, z);
-					if(_node) value += _node->nodeData.solution * stencil.at(x, y, z);
-				}
-			}
-		}
-	} else {
-		for(int x = range.xStart; x != range.xEnd; ++x) {
-			for(int y = range.yStart; y != range.yEnd; ++y) {
-				for(int z = range.zStart; z != range.zEnd; ++z) {
-					TreeOctNode const* _node = neighbors.at(x, y, z);
-					if(_node) {
-						int _d;
-						int _off[3];
-						_node->depthAndOffset(_d, _off);
-						value += _node->nodeData.solution *
-							evaluator.value(d, off[0], cx, _off[0], false, false) *
-							evaluator.value(d, off[1], cy, _off[1], false, false) *
-							evaluator.value(d, off[2], cz, _off[2], false, false);
-					}
-				}
+	for(int x = 0; x != 3; ++x)
+		for(int y = 0; y != 3; ++y)
+			for(int z = 0; z != 3; ++z) {
+				TreeOctNode const* _node = neighbors.at(x, y, z);
+				s[x][y][z] = _node ? _node->nodeData.solution : 0;
 			}
-		}
-	}
+	if(!isInterior) SetCornerWeights(evaluator, d, off, false, false, weights);
+	(isInterior ? stencil.weights : weights).addValues(s, corners, v);
+
 	if(d > minDepth_) {
-		int _corner = node->parent()->childIndex(node);
-		int _cx;
-		int _cy;
-		int _cz;
-		Cube::FactorCornerIndex(_corner, _cx, _cy, _cz);
-		if(cx !=_cx) {
-			range.xStart = 0;
-			range.xEnd = 3;
-		}
-		if(cy !=_cy) {
-			range.yStart = 0;
-			range.yEnd = 3;
-		}
-		if(cz !=_cz) {
-			range.zStart = 0;
-			range.zEnd = 3;
-		}
-		TreeConstNeighbors3 const& neighbors = neighborKey3.neighbors(d - 1);
-		if(isInterior) {
-			for(int x = range.xStart; x != range.xEnd; ++x) {
-				for(int y = range.yStart; y != range.yEnd; ++y) {
-					for(int z = range.zStart; z != range.zEnd; ++z) {
-						TreeOctNode const* _node = neighbors.at(x, y, z);
-						if(_node) value +=
-							metSolution[_node->nodeData.nodeIndex] * stencils.at(_cx, _cy, _cz).at(x, y, z);
-					}
+		TreeConstNeighbors3 const& pNeighbors = neighborKey3.neighbors(d - 1);
+		for(int x = 0; x != 3; ++x)
+			for(int y = 0; y != 3; ++y)
+				for(int z = 0; z != 3; ++z) {
+					TreeOctNode const* _node = pNeighbors.at(x, y, z);
+					s[x][y][z] = _node ? metSolution[_node->nodeData.nodeIndex] : 0;
 				}
-			}
-		} else {
-			for(int x = range.xStart; x != range.xEnd; ++x) {
-				for(int y = range.yStart; y != range.yEnd; ++y) {
-					for(int z = range.zStart; z != range.zEnd; ++z) {
-						const TreeOctNode* _node = neighbors.at(x, y, z);
-						if(_node) {
-							int _d;
-							int _off[3];
-							_node->depthAndOffset(_d, _off);
-							value += metSolution[_node->nodeData.nodeIndex] *
-								evaluator.value(d, off[0], cx, _off[0], false, true) *
-								evaluator.value(d, off[1], cy, _off[1], false, true) *
-								evaluator.value(d, off[2], cz, _off[2], false, true);
-						}
-					}
-				}
-			}
-		}
+		if(!isInterior) SetCornerWeights(evaluator, d, off, true, false, weights);
+		(isInterior ? stencil.pWeights[node->parent()->childIndex(node)] : weights).addValues(s, corners, v);
 	}
-	return value;
+	for(unsigned c = 0; c != Cube::CORNERS; ++c)
+		if(corners & (1 << c)) values[c] = (Real)v[c];
 }
 
-// TODO: Looks similar to getCornerValue
 template<int Degree, bool OutputDensity>
-Point3D<Real> Octree<Degree, OutputDensity>::getCornerNormal(TreeConstNeighbors5 const& neighbors5,
-		TreeConstNeighbors5 const& pNeighbors5, TreeOctNode const* node, int corner,
+void Octree<Degree, OutputDensity>::getCornerNormals(TreeConstNeighbors5 const& neighbors5,
+		TreeConstNeighbors5 const& pNeighbors5, TreeOctNode const* node, unsigned char corners,
 		std::vector<Real> const& metSolution, CornerEvaluator2 const& evaluator,
-		Stencil<Point3D<double>, 5> const& nStencil, CornerNormalEvaluationStencil const& nStencils,
-		bool isInterior) const {
-	Point3D<double> normal;
-
+		CornerNormalStencil const& nStencil, bool isInterior, Point3D<Real> normals[8]) const {
+	double g[Cube::CORNERS][3] = {};
 	int d;
 	int off[3];
 	node->depthAndOffset(d, off);
 
-	int cx;
-	int cy;
-	int cz;
-	Range3D range = Range3D::FullRange();
-	Cube::FactorCornerIndex(corner, cx, cy, cz);
-	if(cx == 0) range.xEnd = 4;
-	else range.xStart = 1;
-	if(cy == 0) range.yEnd = 4;
-	else range.yStart = 1;
-	if(cz == 0) range.zEnd = 4;
-	else range.zStart = 1;
-	if(isInterior) {
-		for(int x = range.xStart; x != range.xEnd; ++x) {
-			for(int y = range.yStart; y != range.yEnd; ++y) {
-				for(int z = range.zStart; z != range.zEnd; ++z) {
-					TreeOctNode const* _node = neighbors5.at(x, y, z);
-					if(_node) normal += nStencil.at(x, y, z) * _node->nodeData.solution;
-				}
-			}
-		}
-	} else {
-		for(int x = range.xStart; x != range.xEnd; ++x) {
-			for(int y = range.yStart; y != range.yEnd; ++y) {
-				for(int z = range.zStart; z != range.zEnd; ++z) {
-					TreeOctNode const* _node = neighbors5.at(x, y, z);
-					if(_node) {
-						int _d;
-						int _off[3];
-						_node->depthAndOffset(_d, _off);
-						double v[] = { evaluator.value(d, off[0], cx, _off[0], false, false),
-							evaluator.value(d, off[1], cy, _off[1], false, false),
-							evaluator.value(d, off[2], cz, _off[2], false, false) };
-						double dv[] = { evaluator.value(d, off[0], cx, _off[0], true, false),
-							evaluator.value(d, off[1], cy, _off[1], true, false),
-							evaluator.value(d, off[2], cz, _off[2], true, false) };
-						normal +=
-							Point3D<double>(dv[0] * v[1] * v[2], v[0] * dv[1] * v[2], v[0] * v[1] * dv[2]) *
-							_node->nodeData.solution;
-					}
-				}
+	double s[5][5][5];
+	CornerWeights<5> weights;
+	for(int x = 0; x != 5; ++x)
+		for(int y = 0; y != 5; ++y)
+			for(int z = 0; z != 5; ++z) {
+				TreeOctNode const* _node = neighbors5.at(x, y, z);
+				s[x][y][z] = _node ? _node->nodeData.solution : 0;
 			}
-		}
-	}
+	if(!isInterior) SetCornerWeights(evaluator, d, off, false, true, weights);
+	CornerWeights<5> const& w = isInterior ? nStencil.weights : weights;
+	w.addGradients(s, corners, g);
+
 	if(d > minDepth_) {
-		int _cx;
-		int _cy;
-		int _cz;
-		int _corner = node->parent()->childIndex(node);
-		Cube::FactorCornerIndex(_corner, _cx, _cy, _cz);
-		if(cx !=_cx) {
-			range.xStart = 0;
-			range.xEnd = 5;
-		}
-		if(cy !=_cy) {
-			range.yStart = 0;
-			range.yEnd = 5;
-		}
-		if(cz !=_cz) {
-			range.zStart = 0;
-			range.zEnd = 5;
-		}
-		if(isInterior) {
-			for(int x = range.xStart; x != range.xEnd; ++x) {
-				for(int y = range.yStart; y != range.yEnd; ++y) {
-					for(int z = range.zStart; z != range.zEnd; ++z) {
-						TreeOctNode const* _node = pNeighbors5.at(x, y, z);
-						if(_node) normal += nStencils.at(_cx, _cy, _cz).at(x, y, z) *
-							metSolution[_node->nodeData.nodeIndex];
-					}
+		for(int x = 0; x != 5; ++x)
+			for(int y = 0; y != 5; ++y)
+				for(int z = 0; z != 5; ++z) {
+					TreeOctNode const* _node = pNeighbors5.at(x, y, z);
+					s[x][y][z] = _node ? metSolution[_node->nodeData.nodeIndex] : 0;
 				}
-			}
-		} else {
-			for(int x = range.xStart; x != range.xEnd; ++x) {
-				for(int y = range.yStart; y != range.yEnd; ++y) {
-					for(int z = range.zStart; z != range.zEnd; ++z) {
-						TreeOctNode const* _node = pNeighbors5.at(x, y, z);
-						if(_node) {
-							int _d;
-							int _off[3];
-							_node->depthAndOffset(_d, _off);
-							double v[] = { evaluator.value(d, off[0], cx, _off[0], false, true),
-								evaluator.value(d, off[1], cy, _off[1], false, true),
-								evaluator.value(d, off[2], cz, _off[2], false, true) };
-							double dv[] = { evaluator.value(d, off[0], cx, _off[0], true, true),
-								evaluator.value(d, off[1], cy, _off[1], true, true),
-								evaluator.value(d, off[2], cz, _off[2], true, true) };
-							normal +=
-								Point3D<double>(dv[0] * v[1] * v[2], v[0] * dv[1] * v[2], v[0] * v[1] * dv[2]) *
-								metSolution[_node->nodeData.nodeIndex];
-						}
-					}
-				}
-			}
-		}
+		if(!isInterior) SetCornerWeights(evaluator, d, off, true, true, weights);
+		CornerWeights<5> const& pw = isInterior ? nStencil.pWeights[node->parent()->childIndex(node)] : weights;
+		pw.addGradients(s, corners, g);
 	}
-	return Point3D<Real>(normal);
+	for(unsigned c = 0; c != Cube::CORNERS; ++c)
+		if(corners & (1 << c)) normals[c] = Point3D<Real>((Real)g[c][0], (Real)g[c][1], (Real)g[c][2]);
+}
+
+template<int Degree, bool OutputDensity>
+void Octree<Degree, OutputDensity>::getCornerNormals(TreeConstNeighborKey3& neighborKey3,
+		TreeOctNode const* node, unsigned char corners, std::vector<Real> const& metSolution,
+		CornerEvaluator2 const& evaluator, CornerNormalStencil const& nStencil,
+		Point3D<Real> normals[8]) const {
+	TreeConstNeighbors5 neighbors5 = neighborKey3.getNeighbors5(node);
+	TreeConstNeighbors5 pNeighbors5;
+	if(node->parent()) pNeighbors5 = neighborKey3.getNeighbors5(node->parent());
+	getCornerNormals(neighbors5, pNeighbors5, node, corners, metSolution, evaluator, nStencil,
+			IsCornerInterior(node), normals);
 }
 
 template<int Degree, bool OutputDensity>
@@ -2573,33 +3487,57 @@ Real Octree<Degree, OutputDensity>::GetIsoValue() const {
 }
 
 template<int Degree, bool OutputDensity>
-void Octree<Degree, OutputDensity>::SetIsoCorners(Real isoValue, TreeOctNode* leaf,
-		CornerTableData& cData, char* valuesSet, Real* values, TreeConstNeighborKey3& nKey,
-		std::vector<Real> const& metSolution, CornerEvaluator2 const& evaluator,
-		CornerEvaluationStencil const& stencil, CornerEvaluationStencils const& stencils) {
-	Real cornerValues[Cube::CORNERS];
-	typename SortedTreeNodes< OutputDensity >::CornerIndices const& cIndices = cData[leaf];
-
+bool Octree<Degree, OutputDensity>::IsCornerInterior(TreeOctNode const* leaf) const {
 	int d;
 	int off[3];
 	leaf->depthAndOffset(d, off);
 	int mn = boundaryType_ == BoundaryTypeNone ? (1 << (d - 2)) + 2 : 2;
 	int mx = (1 << d) - mn;
-	bool isInterior =
-		off[0] >= mn && off[0] < mx && off[1] >= mn && off[1] < mx && off[2] >= mn && off[2] < mx;
+	return off[0] >= mn && off[0] < mx && off[1] >= mn && off[1] < mx && off[2] >= mn && off[2] < mx;
+}
+
+// Only the owner of a corner writes its value, so the leaves of a depth can run in parallel without two
+// of them evaluating the same corner, and the value does not depend on which leaf gets there first.
+template<int Degree, bool OutputDensity>
+void Octree<Degree, OutputDensity>::SetOwnedCornerValues(TreeOctNode const* leaf, unsigned char owned,
+		CornerTableData const& cData, char* valuesSet, Real* values, TreeConstNeighborKey3& nKey,
+		std::vector<Real> const& metSolution, CornerEvaluator2 const& evaluator,
+		CornerValueStencil const& stencil) {
+	if(!owned) return;
+	typename SortedTreeNodes<OutputDensity>::CornerIndices const& cIndices = cData[leaf];
+	Real cornerValues[Cube::CORNERS];
 	nKey.getNeighbors3(leaf);
+	getCornerValues(nKey, leaf, owned, metSolution, evaluator, stencil, IsCornerInterior(leaf), cornerValues);
 	for(unsigned c = 0; c != Cube::CORNERS; ++c) {
-		int vIndex = cIndices[c];
-		if(valuesSet[vIndex]) cornerValues[c] = values[vIndex];
-		else {
-			int x;
-			int y;
-			int z;
-			Cube::FactorCornerIndex(c, x, y, z);
-			cornerValues[c] = getCornerValue(nKey, leaf, c, metSolution, evaluator,
-					stencil.at(x, y, z), stencils.at(x, y, z), isInterior);
-			values[vIndex] = cornerValues[c];
-			valuesSet[vIndex] = 1;
+		if(!(owned & (1 << c))) continue;
+		values[cIndices[c]] = cornerValues[c];
+		valuesSet[cIndices[c]] = 1;
+	}
+}
+
+// The corners not set yet are evaluated here. The owner passes set all those of the finer leaves, so this
+// only happens in the serial pass over the leaves at the subdivision depth and coarser.
+template<int Degree, bool OutputDensity>
+void Octree<Degree, OutputDensity>::SetIsoCorners(Real isoValue, TreeOctNode* leaf,
+		CornerTableData& cData, char* valuesSet, Real* values, TreeConstNeighborKey3& nKey,
+		std::vector<Real> const& metSolution, CornerEvaluator2 const& evaluator,
+		CornerValueStencil const& stencil) {
+	Real cornerValues[Cube::CORNERS];
+	typename SortedTreeNodes< OutputDensity >::CornerIndices const& cIndices = cData[leaf];
+
+	unsigned char unset = 0;
+	for(unsigned c = 0; c != Cube::CORNERS; ++c) {
+		if(valuesSet[cIndices[c]]) cornerValues[c] = values[cIndices[c]];
+		else unset |= 1 << c;
+	}
+	if(unset) {
+		nKey.getNeighbors3(leaf);
+		getCornerValues(nKey, leaf, unset, metSolution, evaluator, stencil, IsCornerInterior(leaf),
+				cornerValues);
+		for(unsigned c = 0; c != Cube::CORNERS; ++c) {
+			if(!(unset & (1 << c))) continue;
+			values[cIndices[c]] = cornerValues[c];
+			valuesSet[cIndices[c]] = 1;
 		}
 	}
 	leaf->nodeData.mcIndex = MarchingCubes::GetIndex(cornerValues, isoValue);
@@ -2702,8 +3640,7 @@ template<class Vertex>
 int Octree<Degree, OutputDensity>::GetRoot(RootInfo<OutputDensity> const& ri, Real isoValue,
 		TreeConstNeighborKey3& neighborKey3, Vertex& vertex, RootData<OutputDensity>& rootData,
 		int sDepth, std::vector<Real> const& metSolution, CornerEvaluator2 const& evaluator,
-		CornerNormalEvaluationStencil const& nStencil, CornerNormalEvaluationStencils const& nStencils,
-		bool nonLinearFit) {
+		CornerNormalStencil const& nStencil, bool nonLinearFit, Point3D<Real> const* normals) {
 	if(!MarchingCubes::HasRoots(ri.node->nodeData.mcIndex)) return 0;
 	if(!MarchingCubes::HasEdgeRoots(ri.node->nodeData.mcIndex, ri.edgeIndex)) return 0;
 
@@ -2728,7 +3665,11 @@ int Octree<Degree, OutputDensity>::GetRoot(RootInfo<OutputDensity> const& ri, Re
 	int iter2 = rootData.cornerIndices(ri.node, c2);
 	keyValue1.first = rootData.cornerValues[iter1];
 	keyValue2.first = rootData.cornerValues[iter2];
-	if(isBoundary) {
+	if(normals) {
+		haveKey1 = haveKey2 = true;
+		keyValue1.second = normals[c1];
+		keyValue2.second = normals[c2];
+	} else if(isBoundary) {
 #pragma omp critical (normal_hash_access)
 		{
 			haveKey1 = rootData.boundaryValues.find(key1) != rootData.boundaryValues.end();
@@ -2742,34 +3683,13 @@ int Octree<Degree, OutputDensity>::GetRoot(RootInfo<OutputDensity> const& ri, Re
 		if(haveKey1) keyValue1.second = rootData.cornerNormals[iter1];
 		if(haveKey2) keyValue2.second = rootData.cornerNormals[iter2];
 	}
-	TreeConstNeighbors5 neighbors5;
-	TreeConstNeighbors5 pNeighbors5;
-	bool isInterior = false;
 	if(!haveKey1 || !haveKey2) {
-		neighbors5 = neighborKey3.getNeighbors5(ri.node);
-		if(ri.node->parent()) pNeighbors5 = neighborKey3.getNeighbors5(ri.node->parent());
-		int d;
-		int off[3];
-		ri.node->depthAndOffset(d, off);
-		int mn = boundaryType_ == BoundaryTypeNone ? (1 << (d - 2)) + 2 : 2;
-		int mx = (1 << d) - mn;
-		isInterior =
-			off[0] >= mn && off[0] < mx && off[1] >= mn && off[1] < mx && off[2] >= mn && off[2] < mx;
-	}
-	int c1x;
-	int c1y;
-	int c1z;
-	Cube::FactorCornerIndex(c1, c1x, c1y, c1z);
-	int c2x;
-	int c2y;
-	int c2z;
-	Cube::FactorCornerIndex(c2, c2x, c2y, c2z);
-	if(!haveKey1)
-		keyValue1.second = getCornerNormal(neighbors5, pNeighbors5, ri.node, c1, metSolution, evaluator,
-				nStencil.at(c1x, c1y, c1z), nStencils.at(c1x, c1y, c1z), isInterior);
-	if(!haveKey2)
-		keyValue2.second = getCornerNormal(neighbors5, pNeighbors5, ri.node, c2, metSolution, evaluator,
-				nStencil.at(c2x, c2y, c2z), nStencils.at(c2x, c2y, c2z), isInterior);
+		Point3D<Real> normals[Cube::CORNERS];
+		unsigned char corners = (haveKey1 ? 0 : 1 << c1) | (haveKey2 ? 0 : 1 << c2);
+		getCornerNormals(neighborKey3, ri.node, corners, metSolution, evaluator, nStencil, normals);
+		if(!haveKey1) keyValue1.second = normals[c1];
+		if(!haveKey2) keyValue2.second = normals[c2];
+	}
 	Point3D<Real> n[2] = { keyValue1.second, keyValue2.second };
 	double x0 = keyValue1.first;
 	double x1 = keyValue2.first;
@@ -3010,11 +3930,9 @@ int Octree<Degree, OutputDensity>::GetRootIndex(RootInfo<OutputDensity> const& r
 template<int Degree, bool OutputDensity>
 template<class Vertex>
 int Octree<Degree, OutputDensity>::SetMCRootPositions(TreeOctNode* node, int sDepth, Real isoValue,
-		TreeConstNeighborKey3& neighborKey3, RootData<OutputDensity>& rootData,
-		std::vector<Vertex>* interiorVertices, CoredFileMeshData<Vertex>* mesh,
-		std::vector<Real> const& metSolution, CornerEvaluator2 const& evaluator,
-		CornerNormalEvaluationStencil const& nStencil, CornerNormalEvaluationStencils const& nStencils,
-		bool nonLinearFit) {
+		TreeConstNeighborKey3& neighborKey3, RootData<OutputDensity>& rootData, int* slots,
+		CoredFileMeshData<Vertex>* mesh, std::vector<Real> const& metSolution,
+		CornerEvaluator2 const& evaluator, CornerNormalStencil const& nStencil, bool nonLinearFit) {
 	int count = 0;
 	if(!MarchingCubes::HasRoots(node->nodeData.mcIndex)) return 0;
 	for(int i = 0; i != DIMENSION; ++i) {
@@ -3036,7 +3954,7 @@ int Octree<Degree, OutputDensity>::SetMCRootPositions(TreeOctNode* node, int sDe
 					if(iter != end) continue;
 					// Get the root information
 					GetRoot(ri, isoValue, neighborKey3, vertex, rootData, sDepth, metSolution, evaluator,
-							nStencil, nStencils, nonLinearFit);
+							nStencil, nonLinearFit);
 					vertex.point = vertex.point * scale_ + center_;
 					// Add the root if it hasn't been added already
 #pragma omp critical (boundary_roots_hash_access)
@@ -3052,20 +3970,8 @@ int Octree<Degree, OutputDensity>::SetMCRootPositions(TreeOctNode* node, int sDe
 				} else {
 					int nodeEdgeIndex = rootData.edgeIndices(ri.node, ri.edgeIndex);
 					if(rootData.edgesSet[nodeEdgeIndex]) continue;
-					// Get the root information
-					GetRoot(ri, isoValue, neighborKey3, vertex, rootData, sDepth, metSolution, evaluator,
-							nStencil, nStencils, nonLinearFit);
-					vertex.point = vertex.point * scale_ + center_;
-					// Add the root if it hasn't been added already
-#pragma omp critical (add_point_access)
-					{
-						if(!rootData.edgesSet[nodeEdgeIndex]) {
-							rootData.interiorRoots[nodeEdgeIndex] = mesh->addOutOfCorePoint(vertex);
-							interiorVertices->push_back(vertex);
-							rootData.edgesSet[nodeEdgeIndex] = 1;
-							++count;
-						}
-					}
+					slots[eIndex] = nodeEdgeIndex;
+					++count;
 				}
 			}
 		}
@@ -3073,6 +3979,47 @@ int Octree<Degree, OutputDensity>::SetMCRootPositions(TreeOctNode* node, int sDe
 	return count;
 }
 
+template<int Degree, bool OutputDensity>
+template<class Vertex>
+void Octree<Degree, OutputDensity>::SetMCInteriorRoots(TreeOctNode* node, int sDepth, Real isoValue,
+		TreeConstNeighborKey3& neighborKey3, RootData<OutputDensity>& rootData, int const* slots,
+		std::vector<Vertex>& interiorVertices, int offSet, std::vector<Real> const& metSolution,
+		CornerEvaluator2 const& evaluator, CornerNormalStencil const& nStencil, bool nonLinearFit) {
+	RootInfo<OutputDensity> ri[Cube::EDGES];
+	unsigned char corners = 0;
+	for(unsigned e = 0; e != Cube::EDGES; ++e) {
+		if(slots[e] < 0) continue;
+		GetRootIndex(node, e, fData_.depth(), neighborKey3, ri[e]);
+		if(ri[e].node != node) continue;
+		int c1;
+		int c2;
+		Cube::EdgeCorners(e, c1, c2);
+		corners |= (1 << c1) | (1 << c2);
+	}
+
+	// The normals of the corners of the node's own roots are evaluated together. A root found on the edge
+	// of a finer leaf, which that leaf did not get to, gets the normals of its corners from that leaf.
+	Point3D<Real> normals[Cube::CORNERS];
+	Point3D<Real> rNormals[Cube::CORNERS];
+	if(corners) getCornerNormals(neighborKey3, node, corners, metSolution, evaluator, nStencil, normals);
+	for(unsigned e = 0; e != Cube::EDGES; ++e) {
+		if(slots[e] < 0) continue;
+		Point3D<Real> const* _normals = normals;
+		if(ri[e].node != node) {
+			int c1;
+			int c2;
+			Cube::EdgeCorners(ri[e].edgeIndex, c1, c2);
+			getCornerNormals(neighborKey3, ri[e].node, (1 << c1) | (1 << c2), metSolution, evaluator, nStencil,
+					rNormals);
+			_normals = rNormals;
+		}
+		Vertex& vertex = interiorVertices[rootData.interiorRoots[slots[e]] - offSet];
+		GetRoot(ri[e], isoValue, neighborKey3, vertex, rootData, sDepth, metSolution, evaluator, nStencil,
+				nonLinearFit, _normals);
+		vertex.point = vertex.point * scale_ + center_;
+	}
+}
+
 template<int Degree, bool OutputDensity>
 void Octree<Degree, OutputDensity>::GetMCIsoEdges(TreeOctNode* node, TreeConstNeighborKey3& neighborKey3,
 		int sDepth, edges_t& edges) {
@@ -3173,7 +4120,8 @@ template<class Vertex>
 int Octree<Degree, OutputDensity>::GetMCIsoTriangles(TreeOctNode* node,
 		TreeConstNeighborKey3& neighborKey3, CoredFileMeshData<Vertex>* mesh,
 		RootData<OutputDensity>& rootData, std::vector<Vertex>* interiorVertices, int offSet,
-		int sDepth, bool polygonMesh, std::vector<Vertex>* barycenters) {
+		int sDepth, bool polygonMesh, std::vector<Vertex>* barycenters,
+		MinimalAreaTriangulation<Real>& MAT) {
 	edges_t edges;
 	GetMCIsoEdges(node, neighborKey3, sDepth, edges);
 
@@ -3188,7 +4136,7 @@ int Octree<Degree, OutputDensity>::GetMCIsoTriangles(TreeOctNode* node,
 				std::cout << "Bad Point Index" << std::endl;
 			else edgeIndices.push_back(p);
 		}
-		tris += AddTriangles(mesh, edgeIndices, interiorVertices, offSet, polygonMesh, barycenters);
+		tris += AddTriangles(mesh, edgeIndices, interiorVertices, offSet, polygonMesh, barycenters, MAT);
 	}
 	return tris;
 }
@@ -3240,8 +4188,7 @@ template<int Degree, bool OutputDensity>
 template<class Vertex>
 int Octree<Degree, OutputDensity>::AddTriangles(CoredFileMeshData<Vertex>* mesh,
 		std::vector<CoredPointIndex>& edges, std::vector<Vertex>* interiorVertices, int offSet,
-		bool polygonMesh, std::vector<Vertex>* barycenters) {
-	MinimalAreaTriangulation<Real> MAT;
+		bool polygonMesh, std::vector<Vertex>* barycenters, MinimalAreaTriangulation<Real>& MAT) {
 	std::vector<Point3D<Real> > vertices;
 	std::vector<TriangleIndex> triangles;
 	if(polygonMesh) {
@@ -3254,20 +4201,21 @@ int Octree<Degree, OutputDensity>::AddTriangles(CoredFileMeshData<Vertex>* mesh,
 		return 1;
 	}
 	if(edges.size() > 3) {
-		bool isCoplanar = false;
+		// Get the points once, for both the coplanarity test and the triangulation
+		vertices.resize(edges.size());
+		for(int i = 0; i != (int)edges.size(); ++i) {
+			vertices[i] = edges[i].inCore ?
+				mesh->inCorePoints(edges[i].index).point :
+				(*interiorVertices)[edges[i].index - offSet].point;
+		}
 
+		bool isCoplanar = false;
 		if(barycenters) {
-			for(unsigned i = 0; i != edges.size(); ++i) {
-				for(unsigned j = 0; j != i; ++j) {
+			for(unsigned i = 0; i != edges.size() && !isCoplanar; ++i) {
+				for(unsigned j = 0; j != i && !isCoplanar; ++j) {
 					if((i + 1) % edges.size() != j && (j + 1) % edges.size() != i) {
-						Vertex v1 = edges[i].inCore ?
-							mesh->inCorePoints(edges[i].index) :
-							(*interiorVertices)[edges[i].index - offSet];
-						Vertex v2 = edges[j].inCore ?
-							mesh->inCorePoints(edges[j].index) :
-							(*interiorVertices)[edges[j].index - offSet];
 						for(int k = 0; k != 3; ++k) {
-							if(v1.point[k] == v2.point[k]) isCoplanar = true;
+							if(vertices[i][k] == vertices[j][k]) isCoplanar = true;
 						}
 					}
 				}
@@ -3285,8 +4233,8 @@ int Octree<Degree, OutputDensity>::AddTriangles(CoredFileMeshData<Vertex>* mesh,
 			int cIdx = mesh->addOutOfCorePoint(c);
 #pragma omp critical (add_barycenter_access)
 			barycenters->push_back(c);
+			std::vector<CoredVertexIndex> vertices(3);
 			for(int i = 0; i != (int)edges.size(); ++i) {
-				std::vector<CoredVertexIndex> vertices(3);
 				vertices[0].idx = edges[i].index;
 				vertices[1].idx = edges[(i + 1) % edges.size()].index;
 				vertices[2].idx = cIdx;
@@ -3297,17 +4245,9 @@ int Octree<Degree, OutputDensity>::AddTriangles(CoredFileMeshData<Vertex>* mesh,
 			}
 			return edges.size();
 		} else {
-			vertices.resize(edges.size());
-			// Add the points
-			for(int i = 0; i != (int)edges.size(); ++i) {
-				Vertex p = edges[i].inCore ?
-					mesh->inCorePoints(edges[i].index) :
-					(*interiorVertices)[edges[i].index-offSet];
-				vertices[i] = p.point;
-			}
 			MAT.GetTriangulation(vertices, triangles);
+			std::vector<CoredVertexIndex> _vertices(3);
 			for(int i = 0; i != (int)triangles.size(); ++i) {
-				std::vector<CoredVertexIndex> _vertices(3);
 				for(int j = 0; j != 3; ++j) {
 					_vertices[j].idx = edges[triangles[i].idx[j]].index;
 					_vertices[j].inCore = edges[triangles[i].idx[j]].inCore != 0;
@@ -3326,6 +4266,28 @@ int Octree<Degree, OutputDensity>::AddTriangles(CoredFileMeshData<Vertex>* mesh,
 	return (int)edges.size() - 2;
 }
 
+template<int Degree, bool OutputDensity>
+void Octree<Degree, OutputDensity>::SetSolutionGridSpan(BSplineData<Degree, Real> const& fData, int res,
+		TreeOctNode const* node, int idx[3], int start[3], int end[3]) const {
+	int d;
+	node->depthAndOffset(d, idx);
+	for(int i = 0; i != 3; ++i) {
+		// Get the index of the functions
+		idx[i] = BinaryNode<double>::CenterIndex(d, idx[i]);
+		// Figure out which samples fall into the range
+		fData.setSampleSpan(idx[i], start[i], end[i]);
+		// We only care about the odd indices
+		if(!(start[i] & 1)) ++start[i];
+		if(!(end[i] & 1)) --end[i];
+		if(boundaryType_ == BoundaryTypeNone) {
+			// (start[i]-1)>>1 >=   res/2 
+			// (  end[i]-1)<<1 <  3*res/2
+			start[i] = std::max(start[i], res + 1);
+			end[i] = std::min(end[i], 3 * res - 1);
+		}
+	}
+}
+
 // TODO: Add voxel grid output test cases
 template< int Degree , bool OutputDensity >
 std::vector<Real> Octree<Degree, OutputDensity>::GetSolutionGrid(int& res, Real isoValue, int depth) {
@@ -3340,26 +4302,10 @@ std::vector<Real> Octree<Degree, OutputDensity>::GetSolutionGrid(int& res, Real
 	for(TreeOctNode* n = tree_.nextNode(); n; n = tree_.nextNode(n)) {
 		if(n->depth() > (boundaryType_ == BoundaryTypeNone ? depth + 1 : depth)) continue;
 		if(n->depth() < minDepth_) continue;
-		int d;
 		int idx[3];
-		n->depthAndOffset(d, idx);
 		int start[3];
 		int end[3];
-		for(int i = 0; i != 3; ++i) {
-			// Get the index of the functions
-			idx[i] = BinaryNode<double>::CenterIndex(d, idx[i]);
-			// Figure out which samples fall into the range
-			fData.setSampleSpan(idx[i], start[i], end[i]);
-			// We only care about the odd indices
-			if(!(start[i] & 1)) ++start[i];
-			if(!(end[i] & 1)) --end[i];
-			if(boundaryType_ == BoundaryTypeNone) {
-				// (start[i]-1)>>1 >=   res/2 
-				// (  end[i]-1)<<1 <  3*res/2
-				start[i] = std::max(start[i], res + 1);
-				end[i] = std::min(end[i], 3 * res - 1);
-			}
-		}
+		SetSolutionGridSpan(fData, res, n, idx, start, end);
 		Real coefficient = n->nodeData.solution;
 		for(int x = start[0]; x <= end[0]; x += 2) {
 			for(int y = start[1]; y <= end[1]; y += 2) {
@@ -3387,6 +4333,440 @@ std::vector<Real> Octree<Degree, OutputDensity>::GetSolutionGrid(int& res, Real
 	return values;
 }
 
+// Adds the B-splines of the node and of its descendants, down to the depth of fData, to the values at
+// the voxels (axes[0][i], axes[1][j], axes[2][k]), stored x fastest. The support of a child lies within
+// the support of its parent, so the subtrees whose parent misses the voxels are skipped.
+template<int Degree, bool OutputDensity>
+void Octree<Degree, OutputDensity>::AddGridValues(BSplineData<Degree, Real> const& fData, int res,
+		TreeOctNode const* node, std::vector<int> const axes[3], Real* values) const {
+	int d;
+	int off[3];
+	node->depthAndOffset(d, off);
+	// The B-spline is supported on the cells off-1 to off+1, whose voxels are those (strictly) inside
+	int shift = boundaryType_ == BoundaryTypeNone ? res / 2 : 0;
+	int scale = 1 << (fData.depth() - d);
+	int idx[3];
+	int first[3];
+	int last[3];
+	for(int i = 0; i != 3; ++i) {
+		idx[i] = BinaryNode<double>::CenterIndex(d, off[i]);
+		std::vector<int> const& axis = axes[i];
+		first[i] = std::lower_bound(axis.begin(), axis.end(), (off[i] - 1) * scale - shift) - axis.begin();
+		last[i] = std::lower_bound(axis.begin(), axis.end(), (off[i] + 2) * scale - shift) - axis.begin();
+		if(first[i] >= last[i]) return;
+	}
+	if(d >= minDepth_) {
+		size_t functionCount = fData.functionCount();
+		size_t nx = axes[0].size();
+		size_t ny = axes[1].size();
+		Real coefficient = node->nodeData.solution;
+		for(int z = first[2]; z != last[2]; ++z) {
+			size_t zSample = 2 * (axes[2][z] + shift) + 1;
+			Real vz = coefficient * fData.valueTables(idx[2] + zSample * functionCount);
+			for(int y = first[1]; y != last[1]; ++y) {
+				size_t ySample = 2 * (axes[1][y] + shift) + 1;
+				Real vyz = vz * fData.valueTables(idx[1] + ySample * functionCount);
+				Real* row = values + (z * ny + y) * nx;
+				for(int x = first[0]; x != last[0]; ++x) {
+					size_t xSample = 2 * (axes[0][x] + shift) + 1;
+					row[x] += vyz * fData.valueTables(idx[0] + xSample * functionCount);
+				}
+			}
+		}
+	}
+	if(d < fData.depth() && node->hasChildren())
+		for(unsigned c = 0; c != Cube::CORNERS; ++c) AddGridValues(fData, res, node->child(c), axes, values);
+}
+
+template<int Degree, bool OutputDensity>
+SparseVoxelGrid Octree<Degree, OutputDensity>::GetSparseSolutionGrid(Real isoValue, int depth, int band) {
+	int maxDepth = boundaryType_ == BoundaryTypeNone ? tree_.maxDepth() - 1 : tree_.maxDepth();
+	if(depth <= 0 || depth > maxDepth) depth = maxDepth;
+	BSplineData<Degree, Real> fData;
+	fData.set(boundaryType_ == BoundaryTypeNone ? depth + 1 : depth, boundaryType_);
+	fData.setValueTables();
+
+	SparseVoxelGrid grid;
+	grid.res = 1 << depth;
+	grid.blockRes = std::min(SPARSE_VOXEL_BLOCK_SIZE, grid.res);
+	int res = grid.res;
+	int bRes = grid.blockRes;
+	int bDim = res / bRes;
+	band = std::max(band, 0);
+	Real offset = isoValue + (boundaryType_ == BoundaryTypeDirichlet ? (Real)0.5 : 0);
+
+	// Coarse pass over a lattice of SPARSE_VOXEL_SAMPLES^3 cells per block, a slab of blocks at a time. A
+	// block is active if the values at the corners of one of its cells straddle the iso-value, or if one
+	// of them is within <band> voxels of it at the steepest slope along the cells' edges.
+	int step = std::max(bRes / SPARSE_VOXEL_SAMPLES, 1);
+	int cells = bRes / step;
+	std::vector<int> lattice(bDim * cells + 1);
+	for(int i = 0; i != (int)lattice.size(); ++i) lattice[i] = std::min(i * step, res - 1);
+	size_t nx = lattice.size();
+	int chunks = std::max(std::min(threads_, bDim), 1);
+	std::vector<char> flags(bDim * bDim);
+	std::vector<long long> active;
+	for(int bz = 0; bz != bDim; ++bz) {
+#pragma omp parallel for num_threads(threads_)
+		for(int c = 0; c < chunks; ++c) {
+			int yStart = bDim * c / chunks;
+			int yEnd = bDim * (c + 1) / chunks;
+			std::vector<int> axes[] = { lattice,
+					std::vector<int>(lattice.begin() + yStart * cells, lattice.begin() + yEnd * cells + 1),
+					std::vector<int>(lattice.begin() + bz * cells, lattice.begin() + (bz + 1) * cells + 1) };
+			size_t ny = axes[1].size();
+			std::vector<Real> values(nx * ny * axes[2].size(), 0);
+			AddGridValues(fData, res, &tree_, axes, &values[0]);
+			for(size_t i = 0; i != values.size(); ++i) values[i] -= offset;
+			size_t stride[] = { 1, nx, nx * ny };
+			for(int by = yStart; by != yEnd; ++by) {
+				for(int bx = 0; bx != bDim; ++bx) {
+					Real const* block = &values[(by - yStart) * cells * nx + bx * cells];
+					bool straddle = false;
+					Real minValue = std::fabs(block[0]);
+					Real maxDifference = 0;
+					for(int z = 0; z <= cells; ++z) {
+						for(int y = 0; y <= cells; ++y) {
+							for(int x = 0; x <= cells; ++x) {
+								int p[] = { x, y, z };
+								Real const* v = block + z * stride[2] + y * stride[1] + x;
+								minValue = std::min(minValue, (Real)std::fabs(*v));
+								for(int i = 0; i != 3; ++i) {
+									if(p[i] == cells) continue;
+									Real w = v[stride[i]];
+									straddle |= (*v < 0) != (w < 0);
+									maxDifference = std::max(maxDifference, (Real)std::fabs(*v - w));
+								}
+							}
+						}
+					}
+					flags[by * bDim + bx] = straddle || minValue * step < band * maxDifference;
+				}
+			}
+		}
+		for(int b = 0; b != bDim * bDim; ++b)
+			if(flags[b]) active.push_back((long long)bz * bDim * bDim + b);
+	}
+
+	// Keep the blocks within <band> voxels of an active one, and its neighbors since the last corners
+	// of its cells are the first voxels of the next blocks
+	int radius = std::max(1, (band + bRes - 1) / bRes);
+	int width = 2 * radius + 1;
+	std::vector<long long> keys(active.size() * width * width * width);
+#pragma omp parallel for num_threads(threads_)
+	for(int i = 0; i < (int)active.size(); ++i) {
+		int b[] = { (int)(active[i] % bDim), (int)(active[i] / bDim % bDim), (int)(active[i] / bDim / bDim) };
+		long long* key = &keys[(size_t)i * width * width * width];
+		for(int z = b[2] - radius; z <= b[2] + radius; ++z)
+			for(int y = b[1] - radius; y <= b[1] + radius; ++y)
+				for(int x = b[0] - radius; x <= b[0] + radius; ++x)
+					*key++ = x < 0 || y < 0 || z < 0 || x >= bDim || y >= bDim || z >= bDim ? -1 :
+							((long long)z * bDim + y) * bDim + x;
+	}
+	ParallelSort(keys, threads_);
+	keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+	keys.erase(keys.begin(), std::upper_bound(keys.begin(), keys.end(), -1LL));
+
+	// Evaluate the kept blocks
+	int count = (int)keys.size();
+	size_t bSize = bRes * bRes * bRes;
+	grid.blocks.resize(3 * count);
+	grid.values.resize(count * bSize);
+#pragma omp parallel for num_threads(threads_)
+	for(int i = 0; i < count; ++i) {
+		int* b = &grid.blocks[3 * i];
+		b[0] = (int)(keys[i] % bDim);
+		b[1] = (int)(keys[i] / bDim % bDim);
+		b[2] = (int)(keys[i] / bDim / bDim);
+		std::vector<int> axes[3];
+		for(int j = 0; j != 3; ++j)
+			for(int k = 0; k != bRes; ++k) axes[j].push_back(b[j] * bRes + k);
+		AddGridValues(fData, res, &tree_, axes, &grid.values[i * bSize]);
+		for(size_t j = i * bSize; j != (i + 1) * bSize; ++j) grid.values[j] -= offset;
+	}
+	return grid;
+}
+
+template<int Degree, bool OutputDensity>
+unsigned long long Octree<Degree, OutputDensity>::MortonKey(Point3D<Real> const& p) {
+	int const bits = MORTON_KEY_BITS;
+	unsigned long long key = 0;
+	int idx[3];
+	for(int i = 0; i != 3; ++i)
+		idx[i] = clamp((int)(p[i] * (1 << bits)), 0, (1 << bits) - 1);
+	for(int b = bits - 1; b >= 0; --b)
+		for(int i = 2; i >= 0; --i)
+			key = (key << 1) | ((idx[i] >> b) & 1);
+	return key;
+}
+
+// The Morton key of the cell of the given depth with the given coordinates, a prefix of the keys of the
+// points in it
+template<int Degree, bool OutputDensity>
+unsigned long long Octree<Degree, OutputDensity>::MortonKey(int const idx[3], int depth) {
+	unsigned long long key = 0;
+	for(int b = depth - 1; b >= 0; --b)
+		for(int i = 2; i >= 0; --i)
+			key = (key << 1) | ((idx[i] >> b) & 1);
+	return key;
+}
+
+template<int Degree, bool OutputDensity>
+void Octree<Degree, OutputDensity>::MortonCell(unsigned long long key, int depth, int idx[3]) {
+	idx[0] = idx[1] = idx[2] = 0;
+	for(int b = 0; b != depth; ++b)
+		for(int i = 0; i != 3; ++i)
+			idx[i] |= (int)((key >> (3 * b + i)) & 1) << b;
+}
+
+// Appends the keys of the 3x3x3 neighbors of the cells of the given depth or, if parents is set, those of
+// the parents of the neighbors (the 2x2x2 cells one depth coarser on the side of the cell). The neighbors
+// outside of the unit cube are dropped.
+template<int Degree, bool OutputDensity>
+void Octree<Degree, OutputDensity>::AddNeighborKeys(std::vector<unsigned long long> const& cells, int depth,
+		bool parents, std::vector<unsigned long long>& keys) {
+	int res = 1 << depth;
+	int shift = parents ? 1 : 0;
+	for(size_t i = 0; i != cells.size(); ++i) {
+		int idx[3];
+		int start[3];
+		int end[3];
+		MortonCell(cells[i], depth, idx);
+		for(int j = 0; j != 3; ++j) {
+			start[j] = std::max(idx[j] - 1, 0) >> shift;
+			end[j] = std::min(idx[j] + 1, res - 1) >> shift;
+		}
+		for(idx[0] = start[0]; idx[0] <= end[0]; ++idx[0])
+			for(idx[1] = start[1]; idx[1] <= end[1]; ++idx[1])
+				for(idx[2] = start[2]; idx[2] <= end[2]; ++idx[2])
+					keys.push_back(MortonKey(idx, depth - shift));
+	}
+}
+
+// Merges the added keys into the sorted cells, emptying them
+template<int Degree, bool OutputDensity>
+void Octree<Degree, OutputDensity>::AddCells(std::vector<unsigned long long>& cells,
+		std::vector<unsigned long long>& added, int threads) {
+	ParallelSort(added, threads);
+	std::vector<unsigned long long> merged(cells.size() + added.size());
+	merged.erase(std::set_union(cells.begin(), cells.end(), added.begin(),
+			std::unique(added.begin(), added.end()), merged.begin()), merged.end());
+	cells.swap(merged);
+	std::vector<unsigned long long>().swap(added);
+}
+
+// The sample GetInteriorCells takes for a point splatted into a tree of maxDepth, at the depth found as
+// SplatOrientedPoint does from the sample density of this tree
+template<int Degree, bool OutputDensity>
+unsigned long long Octree<Degree, OutputDensity>::GetReplaySample(Point3D<Real> const& position, int maxDepth,
+		TreeConstNeighborKey3& neighborKey) const {
+	int splatDepth = boundaryType_ == BoundaryTypeNone && splatDepth_ > 0 ? splatDepth_ + 1 : splatDepth_;
+	Real depth = (Real)maxDepth;
+	if(samplesPerNode_ > 0 && splatDepth) {
+		TreeOctNode const* node = &tree_;
+		Point3D<Real> center(0.5, 0.5, 0.5);
+		Real width = 1;
+		while(node->depth() < splatDepth && node->hasChildren()) {
+			int cIndex = TreeOctNode::CornerIndex(center, position);
+			node = node->child(cIndex);
+			width /= 2;
+			center[0] += cIndex & 1 ? width / 2 : -width / 2;
+			center[1] += cIndex & 2 ? width / 2 : -width / 2;
+			center[2] += cIndex & 4 ? width / 2 : -width / 2;
+		}
+		Real weight;
+		GetSampleDepthAndWeight(node, position, GetRootGetNeighborsFunction(neighborKey), samplesPerNode_, depth,
+				weight);
+		depth = clamp(depth, minDepth_, maxDepth);
+	}
+	int topDepth = clamp((int)lrint(std::ceil(depth)), minDepth_, maxDepth);
+	return MortonKey(position) >> 3 * (MORTON_KEY_BITS - maxDepth) << SAMPLE_DEPTH_BITS | topDepth << 1 |
+			(std::abs(topDepth - depth) > EPSILON ? 1 : 0);
+}
+
+// Replays the refinement of setTree, ClipTree and finalize (but not refineBoundary) on the cells of the
+// samples, returning the keys of the cells with children at each depth from the minimum one on (those
+// coarser all have children). Each sample is the key of the cell of maxDepth a point falls in, shifted
+// over SAMPLE_DEPTH_BITS holding the depth the point is splatted at, and in the lowest bit whether it is
+// also splatted one depth coarser. The samples are sorted in place.
+template<int Degree, bool OutputDensity>
+std::vector<std::vector<unsigned long long> > Octree<Degree, OutputDensity>::GetInteriorCells(
+		std::vector<unsigned long long>& samples, int maxDepth) const {
+	ParallelSort(samples, threads_);
+	// The cells the samples are splatted in at each depth, in order as the samples are
+	std::vector<std::vector<unsigned long long> > splatted(maxDepth + 1);
+	for(size_t i = 0; i != samples.size(); ++i) {
+		int d = (int)(samples[i] >> 1) & ((1 << (SAMPLE_DEPTH_BITS - 1)) - 1);
+		for(int e = d; e >= d - (int)(samples[i] & 1); --e) {
+			unsigned long long key = samples[i] >> SAMPLE_DEPTH_BITS >> 3 * (maxDepth - e);
+			if(splatted[e].empty() || splatted[e].back() != key) splatted[e].push_back(key);
+		}
+	}
+
+	// The normals are splatted into the 3x3x3 neighbors of those cells, whose parents and ancestors keep
+	// their children after clipping
+	std::vector<std::vector<unsigned long long> > interior(maxDepth + 1);
+	for(int d = maxDepth; d > minDepth_; --d) {
+		std::vector<unsigned long long> added;
+		AddNeighborKeys(splatted[d], d, true, added);
+		std::vector<unsigned long long>().swap(splatted[d]);
+		for(size_t i = 0; i != interior[d].size(); ++i) added.push_back(interior[d][i] >> 3);
+		AddCells(interior[d - 1], added, threads_);
+	}
+
+	// Finalizing refines the 3x3x3 neighbors of the cells with grandchildren and, for each of their
+	// ancestors, the 2x2x2 neighbors of its parent on its side
+	for(int d = maxDepth; d - 2 >= minDepth_; --d) {
+		std::vector<unsigned long long> ancestors;
+		for(size_t i = 0; i != interior[d - 1].size(); ++i)
+			if(ancestors.empty() || ancestors.back() != interior[d - 1][i] >> 3)
+				ancestors.push_back(interior[d - 1][i] >> 3);
+		std::vector<unsigned long long> neighbors;
+		AddNeighborKeys(ancestors, d - 2, false, neighbors);
+		for(int e = d - 2; e > minDepth_; --e) {
+			std::vector<unsigned long long> added;
+			AddNeighborKeys(ancestors, e, true, added);
+			AddCells(interior[e - 1], added, threads_);
+			size_t count = 0;
+			for(size_t i = 0; i != ancestors.size(); ++i)
+				if(!count || ancestors[count - 1] != ancestors[i] >> 3) ancestors[count++] = ancestors[i] >> 3;
+			ancestors.resize(count);
+		}
+		AddCells(interior[d - 2], neighbors, threads_);
+	}
+	return interior;
+}
+
+// Adds the contribution of the (up to) 3x3x3 B-splines centered on the neighbors. If coefficients
+// is null the nodes' own solution is used, otherwise the coefficients are indexed by node index.
+template<int Degree, bool OutputDensity>
+void Octree<Degree, OutputDensity>::AddPointValue(TreeConstNeighbors3 const& neighbors,
+		Point3D<Real> const& p, Real const* coefficients, double& value, Point3D<double>* gradient) const {
+	int d;
+	int off[3];
+	neighbors.at(1, 1, 1)->depthAndOffset(d, off);
+	double v[3][3] = {};
+	double dv[3][3] = {};
+	for(int i = 0; i != 3; ++i) {
+		for(int j = 0; j != 3; ++j) {
+			if(off[i] - 1 + j < 0 || off[i] - 1 + j >= (1 << d)) continue;
+			int idx = BinaryNode<double>::CenterIndex(d, off[i] - 1 + j);
+			v[i][j] = fData_.baseBSplines(idx, 2 - j)(p[i]);
+			if(gradient) dv[i][j] = fData_.baseBSplines(idx, 2 - j).derivative()(p[i]);
+		}
+	}
+	for(int i = 0; i != 3; ++i) {
+		for(int j = 0; j != 3; ++j) {
+			for(int k = 0; k != 3; ++k) {
+				TreeOctNode const* node = neighbors.at(i, j, k);
+				if(!node || node->nodeData.nodeIndex < 0) continue;
+				double c = coefficients ? coefficients[node->nodeData.nodeIndex] : node->nodeData.solution;
+				value += c * v[0][i] * v[1][j] * v[2][k];
+				if(gradient)
+					*gradient += Point3D<double>(dv[0][i] * v[1][j] * v[2][k], v[0][i] * dv[1][j] * v[2][k],
+							v[0][i] * v[1][j] * dv[2][k]) * c;
+			}
+		}
+	}
+}
+
+// Adds the contribution of the descendants of node whose B-splines overlap the point
+template<int Degree, bool OutputDensity>
+void Octree<Degree, OutputDensity>::AddFinerPointValue(TreeOctNode const* node, Point3D<Real> const& p,
+		double& value, Point3D<double>* gradient) const {
+	if(!node->hasChildren()) return;
+	for(unsigned c = 0; c != Cube::CORNERS; ++c) {
+		TreeOctNode const* child = node->child(c);
+		int d;
+		int off[3];
+		child->depthAndOffset(d, off);
+		double v[3];
+		double dv[3];
+		bool overlaps = true;
+		for(int i = 0; i != 3 && overlaps; ++i) {
+			int cell = std::min((int)(p[i] * (1 << d)), (1 << d) - 1);
+			if(cell < off[i] - 1 || cell > off[i] + 1) overlaps = false;
+			else {
+				int idx = BinaryNode<double>::CenterIndex(d, off[i]);
+				v[i] = fData_.baseBSplines(idx, cell - off[i] + 1)(p[i]);
+				if(gradient) dv[i] = fData_.baseBSplines(idx, cell - off[i] + 1).derivative()(p[i]);
+			}
+		}
+		if(!overlaps) continue;
+		double s = child->nodeData.solution;
+		value += s * v[0] * v[1] * v[2];
+		if(gradient)
+			*gradient += Point3D<double>(dv[0] * v[1] * v[2], v[0] * dv[1] * v[2], v[0] * v[1] * dv[2]) * s;
+		AddFinerPointValue(child, p, value, gradient);
+	}
+}
+
+template<int Degree, bool OutputDensity>
+void Octree<Degree, OutputDensity>::GetSolutionValues(std::vector<Point3D<Real> > const& points,
+		XForm<Real, 4> const& xForm, Real isoValue, std::vector<Real>& values,
+		std::vector<Point3D<Real> >* gradients) const {
+	int maxDepth = tree_.maxDepth();
+
+	// Express the coarser solution in terms of the B-splines at every depth so that the value at
+	// a point only depends on the neighbors of its leaf and of the leaf's parent
+	std::vector<Real> metSolution(sNodes_.nodeCount[maxDepth], 0);
+#pragma omp parallel for num_threads(threads_)
+	for(int i = sNodes_.nodeCount[minDepth_]; i < sNodes_.nodeCount[maxDepth]; ++i)
+		metSolution[i] = sNodes_.treeNodes[i]->nodeData.solution;
+	for(int d = minDepth_; d < maxDepth; ++d) UpSample(d, sNodes_, &metSolution[0]);
+
+	// Visit the points in Morton order so that consecutive queries share their neighbors
+	int count = (int)points.size();
+	std::vector<Point3D<Real> > unitPoints(count);
+	std::vector<std::pair<unsigned long long, int> > order(count);
+#pragma omp parallel for num_threads(threads_)
+	for(int i = 0; i < count; ++i) {
+		unitPoints[i] = (xForm * points[i] - center_) / scale_;
+		order[i] = std::make_pair(MortonKey(unitPoints[i]), i);
+	}
+	ParallelSort(order, threads_);
+
+	XForm<Real, 3> xFormT = xForm.cut<3>().transpose();
+	Real offset = isoValue + (boundaryType_ == BoundaryTypeDirichlet ? (Real)0.5 : 0);
+	values.resize(count);
+	if(gradients) gradients->resize(count);
+	TreeConstNeighborKey3 nKey(maxDepth);
+#pragma omp parallel for num_threads(threads_) firstprivate(nKey) schedule(static)
+	for(int i = 0; i < count; ++i) {
+		int idx = order[i].second;
+		Point3D<Real> const& p = unitPoints[idx];
+		double value = 0;
+		Point3D<double> gradient;
+		// Outside of the unit cube all the B-splines vanish
+		if(p[0] >= 0 && p[0] <= 1 && p[1] >= 0 && p[1] <= 1 && p[2] >= 0 && p[2] <= 1) {
+			TreeOctNode const* node = &tree_;
+			Point3D<Real> center(0.5, 0.5, 0.5);
+			Real width = 1;
+			while(node->hasChildren()) {
+				int cIndex = TreeOctNode::CornerIndex(center, p);
+				node = node->child(cIndex);
+				width /= 2;
+				center[0] += (cIndex & 1 ? 1 : -1) * width / 2;
+				center[1] += (cIndex & 2 ? 1 : -1) * width / 2;
+				center[2] += (cIndex & 4 ? 1 : -1) * width / 2;
+			}
+			nKey.getNeighbors3(node);
+			int d = node->depth();
+			AddPointValue(nKey.neighbors(d), p, nullptr, value, gradients ? &gradient : nullptr);
+			if(d > minDepth_)
+				AddPointValue(nKey.neighbors(d - 1), p, &metSolution[0], value,
+						gradients ? &gradient : nullptr);
+			// Refined neighbors of the leaf have finer B-splines that can reach into it
+			for(int j = 0; j != 3 * 3 * 3; ++j) {
+				TreeOctNode const* neighbor = nKey.neighbors(d).at(j / 9, (j / 3) % 3, j % 3);
+				if(neighbor) AddFinerPointValue(neighbor, p, value, gradients ? &gradient : nullptr);
+			}
+		}
+		values[idx] = (Real)value - offset;
+		if(gradients) (*gradients)[idx] = xFormT * Point3D<Real>(gradient) / scale_;
+	}
+}
+
 ////////////////
 // VertexData //
 ////////////////
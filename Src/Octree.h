@@ -124,6 +124,8 @@ public:
 	bool initChildren();
 
 	void depthAndOffset(int& depth, int offset[3]) const; 
+	// The depth and offset packed together, which identifies the node within the tree
+	unsigned long long depthAndOffset() const { return _depthAndOffset; }
 	int depth() const { return _depthAndOffset & DepthMask; }
 	void centerAndWidth(Point3D<Real>& center, Real& width) const;
 
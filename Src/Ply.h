@@ -351,14 +351,14 @@ int PlyWritePolygons(std::string const& filename, CoredFileMeshData<Vertex>* mes
 
 template<class Vertex>
 int PlyReadPolygons(char const* fileName,
-					std::vector<Vertex>& vertices,std::vector<std::vector<int> >& polygons,
+					std::vector<Vertex>& vertices,PolygonList& polygons,
 					PlyProperty* properties,int propertyNum,
 					int& file_type,
 					char*** comments=NULL,int* commentNum=NULL , bool* readFlags=NULL );
 
 template<class Vertex>
 int PlyReadPolygons(std::string const& filename, std::vector<Vertex>& vertices,
-		std::vector<std::vector<int> >& polygons, int& file_type,
+		PolygonList& polygons, int& file_type,
 		std::vector<std::string>& comments, bool* readFlags = nullptr) {
 	char** commentsPtr;
 	int commentsSize = 0;
@@ -373,14 +373,14 @@ int PlyReadPolygons(std::string const& filename, std::vector<Vertex>& vertices,
 
 template<class Vertex>
 int PlyWritePolygons(char const* fileName,
-					 const std::vector<Vertex>& vertices,const std::vector<std::vector<int> >& polygons,
+					 const std::vector<Vertex>& vertices,const PolygonList& polygons,
 					 PlyProperty* properties,int propertyNum,
 					 int file_type,
 					 char** comments=NULL,const int& commentNum=0);
 
 template<class Vertex>
 int PlyWritePolygons(std::string const& filename, std::vector<Vertex> const& vertices,
-		std::vector<std::vector<int> > const& polygons, int file_type,
+		PolygonList const& polygons, int file_type,
 		std::vector<std::string> const& comments) {
 	char** commentsPtr = new char*[comments.size()];
 	for(size_t i = 0; i != comments.size(); ++i) {
@@ -394,7 +394,7 @@ int PlyWritePolygons(std::string const& filename, std::vector<Vertex> const& ver
 
 template<class Vertex>
 int PlyWritePolygons(char const* fileName,
-					 const std::vector<Vertex>& vertices , const std::vector< std::vector< int > >& polygons,
+					 const std::vector<Vertex>& vertices , const PolygonList& polygons,
 					 PlyProperty* properties,int propertyNum,
 					 int file_type,
 					 char** comments,const int& commentNum)
@@ -428,34 +428,22 @@ int PlyWritePolygons(char const* fileName,
 	for (int i=0; i < int(vertices.size()); i++)
 		ply_put_element(ply, (void *) &vertices[i]);
 
-	// write faces
+	// write faces, straight from the polygon list
 	PlyFace ply_face;
-	int maxFaceVerts=3;
-	ply_face.nr_vertices = 3;
-	ply_face.vertices = new int[3];
-
 	ply_put_element_setup(ply, "face");
 	for (int i=0; i < nr_faces; i++)
 	{
-		if(int(polygons[i].size())>maxFaceVerts)
-		{
-			delete[] ply_face.vertices;
-			maxFaceVerts=int(polygons[i].size());
-			ply_face.vertices=new int[maxFaceVerts];
-		}
-		ply_face.nr_vertices=int(polygons[i].size());
-		for(int j=0;j<ply_face.nr_vertices;j++)
-			ply_face.vertices[j]=polygons[i][j];
+		ply_face.nr_vertices=polygons.polygonSize(i);
+		ply_face.vertices=const_cast<int*>(polygons[i]);
 		ply_put_element(ply, (void *) &ply_face);
 	}
 
-	delete[] ply_face.vertices;
 	ply_close(ply);
 	return 1;
 }
 template<class Vertex>
 int PlyReadPolygons(char const* fileName,
-					std::vector<Vertex>& vertices , std::vector<std::vector<int> >& polygons ,
+					std::vector<Vertex>& vertices , PolygonList& polygons ,
 					 PlyProperty* properties , int propertyNum ,
 					int& file_type ,
 					char*** comments , int* commentNum , bool* readFlags )
@@ -463,7 +451,7 @@ int PlyReadPolygons(char const* fileName,
 	int nr_elems;
 	char **elist;
 	float version;
-	int i,j,k;
+	int i,j;
 	PlyFile* ply;
 	char* elem_name;
 	int num_elems;
@@ -522,12 +510,12 @@ int PlyReadPolygons(char const* fileName,
 		else if (equal_strings("face", elem_name))
 		{
 			ply_get_property (ply, elem_name, &face_props[0]);
-			polygons.resize(num_elems);
+			polygons.clear();
+			polygons.reserve(num_elems, 3 * (size_t)num_elems);
 			for (j=0; j < num_elems; j++)
 			{
 				ply_get_element (ply, (void *) &ply_face);
-				polygons[j].resize(ply_face.nr_vertices);
-				for(k=0;k<ply_face.nr_vertices;k++)	polygons[j][k]=ply_face.vertices[k];
+				polygons.push_back(ply_face.vertices, ply_face.nr_vertices);
 				free(ply_face.vertices);
 			}  // for, read faces
 		}  // if face
@@ -1529,11 +1529,11 @@ Open a polygon file for reading.
 	  while (*s1 && *s2)
 		  if (*s1++ != *s2++)
 			  return (0);
-		  
-		  if (*s1 != *s2)
-			  return (0);
-		  else
-			  return (1);
+	  
+	  if (*s1 != *s2)
+		  return (0);
+	  else
+		  return (1);
   }
   
   
@@ -1555,8 +1555,8 @@ Open a polygon file for reading.
 	  for (i = 0; i < plyfile->nelems; i++)
 		  if (equal_strings (element, plyfile->elems[i]->name))
 			  return (plyfile->elems[i]);
-		  
-		  return (NULL);
+	  
+	  return (NULL);
   }
   
   
@@ -1581,9 +1581,9 @@ Open a polygon file for reading.
 			  *index = i;
 			  return (elem->props[i]);
 		  }
-		  
-		  *index = -1;
-		  return (NULL);
+	  
+	  *index = -1;
+	  return (NULL);
   }
   
   
@@ -2661,9 +2661,9 @@ Read an element from a binary file.
 	  for (i = PLY_START_TYPE + 1; i < PLY_END_TYPE; i++)
 		  if (equal_strings (type_name, type_names[i]))
 			  return (i);
-		  
-		  /* if we get here, we didn't find the type */
-		  return (0);
+	  
+	  /* if we get here, we didn't find the type */
+	  return (0);
   }
   
   
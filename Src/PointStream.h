@@ -29,6 +29,9 @@ DAMAGE.
 #pragma once
 
 #include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
 
 template<class Real>
 class PointStream {
@@ -79,4 +82,10 @@ private:
 	int _pIdx;
 };
 
+// Reads only the positions of the points: the vertices of a PLY file, the points of a .bnpts file or the
+// first three numbers of each non-blank line of an ASCII file. Reports and returns false if a line holds
+// fewer numbers or a binary file ends with a partial point.
+template<class Real>
+bool ReadPointPositions(std::string const& filename, std::vector<Point3D<Real> >& points);
+
 #include "PointStream.inl"
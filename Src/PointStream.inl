@@ -148,3 +148,55 @@ PointStream<Real>* PointStream<Real>::open(std::string const& filename) {
 	if(strcaseequal(ext, "ply")) return new PLYPointStream<Real>(filename);
 	else return new ASCIIPointStream<Real>(filename);
 }
+
+template<class Real>
+bool ReadPointPositions(std::string const& filename, std::vector<Point3D<Real> >& points) {
+	size_t last_dot = filename.find_last_of('.');
+	std::string ext = last_dot == std::string::npos ? "" : filename.substr(last_dot + 1);
+	points.clear();
+	if(strcaseequal(ext, "ply")) {
+		std::vector<PlyVertex<Real> > vertices;
+		PolygonList polygons;
+		int fileType;
+		std::vector<std::string> comments;
+		if(!PlyReadPolygons(filename, vertices, polygons, fileType, comments)) {
+			std::cerr << "[ERROR] Failed to read ply file: " << filename << std::endl;
+			return false;
+		}
+		for(size_t i = 0; i != vertices.size(); ++i) points.push_back(vertices[i].point);
+		return true;
+	}
+	if(strcaseequal(ext, "bnpts")) {
+		std::ifstream file(filename.c_str(), std::ios_base::binary | std::ios_base::ate);
+		if(!file) {
+			std::cerr << "[ERROR] Failed to open file for reading: " << filename << std::endl;
+			return false;
+		}
+		if(file.tellg() % (6 * sizeof(Real))) {
+			std::cerr << "[ERROR] Expected 6 values per point in: " << filename << std::endl;
+			return false;
+		}
+		BinaryPointStream<Real> pointStream(filename);
+		Point3D<Real> p;
+		Point3D<Real> n;
+		while(pointStream.nextPoint(p, n)) points.push_back(p);
+		return true;
+	}
+	std::ifstream file(filename.c_str());
+	if(!file) {
+		std::cerr << "[ERROR] Failed to open file for reading: " << filename << std::endl;
+		return false;
+	}
+	std::string line;
+	for(int l = 1; std::getline(file, line); ++l) {
+		if(line.find_first_not_of(" \t\r") == std::string::npos) continue;
+		std::istringstream stream(line);
+		Point3D<Real> p;
+		if(!(stream >> p[0] >> p[1] >> p[2])) {
+			std::cerr << "[ERROR] Expected a position on line " << l << " of: " << filename << std::endl;
+			return false;
+		}
+		points.push_back(p);
+	}
+	return true;
+}
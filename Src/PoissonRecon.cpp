@@ -30,6 +30,8 @@ DAMAGE.
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <functional>
+#include <sstream>
 
 #ifndef NO_OMP
 #include <omp.h>
@@ -48,12 +50,16 @@ DAMAGE.
 #include "PPolynomial.h"
 #include "Ply.h"
 #include "SparseMatrix.h"
+#include "SurfaceTrimming.h"
 #include "Time.h"
 
 cmdLine<std::string> In("in");
 cmdLine<std::string> Out("out");
 cmdLine<std::string> VoxelGrid("voxel");
+cmdLine<std::string> SparseVoxel("sparseVoxel");
 cmdLine<std::string> Xform("xForm");
+cmdLine<std::string> Evaluate("evaluate");
+cmdLine<std::string> EvaluateOut("evaluateOut");
 
 #ifdef _WIN32
 cmdLineReadable Performance("performance");
@@ -67,6 +73,9 @@ cmdLineReadable NonManifold("nonManifold");
 cmdLineReadable ASCII("ascii");
 cmdLineReadable Density("density");
 cmdLineReadable Verbose("verbose");
+cmdLineReadable Gradients("gradients");
+cmdLineReadable EstimateOnly("estimate");
+cmdLineReadable AutoDepth("autoDepth");
 
 cmdLine<int> Depth("depth", 8);
 cmdLine<int> SolverDivide("solverDivide", 8);
@@ -76,10 +85,16 @@ cmdLine<int> AdaptiveExponent("adaptiveExp", 1);
 cmdLine<int> MinIters("minIters", 24);
 cmdLine<int> FixedIters("iters", -1);
 cmdLine<int> VoxelDepth("voxelDepth", -1);
+cmdLine<int> VoxelBand("voxelBand", 2);
+cmdLine<int> MergeDepth("mergeDepth");
+cmdLine<std::vector<int> > LODDepths("lodDepths");
+cmdLine<std::vector<float> > RegionOfInterest("roi");
+cmdLine<std::vector<std::string> > Append("append");
 #pragma message("[WARNING] Setting default min-depth to 5")
 cmdLine<int> MinDepth("minDepth", 5);
 cmdLine<int> MaxSolveDepth("maxSolveDepth" );
 cmdLine<int> BoundaryType("boundary", 1);
+cmdLine<int> Smooth("smooth", 5);
 #ifndef NO_OMP
 cmdLine<int> Threads("threads", omp_get_num_procs());
 #else
@@ -90,6 +105,9 @@ cmdLine<float> SamplesPerNode("samplesPerNode", 1);
 cmdLine<float> Scale("scale", 1.1);
 cmdLine<float> SolverAccuracy("accuracy", 1e-3);
 cmdLine<float> PointWeight("pointWeight", 4);
+cmdLine<float> MemoryBudget("memoryBudget", 0);
+cmdLine<float> Trim("trim");
+cmdLine<float> IslandAreaRatio("aRatio", 0.001f);
 
 std::vector<cmdLineReadable*> params;
 
@@ -98,7 +116,9 @@ void BuildParams() {
 		&In, &Depth, &Out, &Xform, &SolverDivide, &IsoDivide, &Scale, &Verbose, &SolverAccuracy, &NoComments,
 		&KernelDepth, &SamplesPerNode, &Confidence, &NormalWeights, &NonManifold, &PolygonMesh, &ASCII,
 		&ShowResidual, &MinIters, &FixedIters, &VoxelDepth, &PointWeight, &VoxelGrid, &Threads, &MinDepth,
-		&MaxSolveDepth, &AdaptiveExponent, &BoundaryType, &Density,
+		&MaxSolveDepth, &AdaptiveExponent, &BoundaryType, &Density, &SparseVoxel, &VoxelBand,
+		&Evaluate, &EvaluateOut, &Gradients, &LODDepths, &RegionOfInterest, &Append, &EstimateOnly,
+		&AutoDepth, &MemoryBudget, &MergeDepth, &Trim, &Smooth, &IslandAreaRatio,
 #ifdef _WIN32
 		&Performance,
 #endif
@@ -114,12 +134,52 @@ void ShowUsage(std::string const& executable) {
 
 	printf( "\t[--%s <ouput triangle mesh>]\n" , Out.name() );
 	printf( "\t[--%s <ouput voxel grid>]\n" , VoxelGrid.name() );
+	printf( "\t[--%s <ouput sparse voxel grid>]\n" , SparseVoxel.name() );
+	printf( "\t\t Only the %d^3 voxel blocks near the iso-surface are written: the resolution,\n",
+			SPARSE_VOXEL_BLOCK_SIZE );
+	printf( "\t\t block resolution and block count, the block coordinates, then the blocks' values.\n" );
+
+	printf( "\t[--%s <input query points>]\n" , Evaluate.name() );
+	printf( "\t[--%s <ouput query values>]\n" , EvaluateOut.name() );
+	printf( "\t\t Evaluates the implicit function (minus the iso-value) at the query points.\n" );
+	printf( "\t\t Only the positions are read: in ASCII files, the first three numbers of each line.\n" );
+	printf( "\t\t The values are written in the order of the points, as binary floats\n" );
+	printf( "\t\t unless --%s is set.\n" , ASCII.name() );
+	printf( "\t[--%s]\n" , Gradients.name() );
+	printf( "\t\t If this flag is enabled, each query value is followed by the function's gradient.\n" );
+
+	printf( "\t[--%s <minX>,<minY>,<minZ>,<maxX>,<maxY>,<maxZ>]\n" , RegionOfInterest.name() );
+	printf( "\t\t Only the part of the iso-surface in the leaves intersecting this box is extracted.\n" );
 
 	printf( "\t[--%s <maximum reconstruction depth>=%d]\n" , Depth.name() , Depth.value() );
 	printf( "\t\t Running at depth d corresponds to solving on a 2^d x 2^d x 2^d\n" );
 	printf( "\t\t voxel grid.\n" );
 
+	printf( "\t[--%s]\n" , AutoDepth.name() );
+	printf( "\t\t If this flag is enabled, the depths that are not given are picked from the\n" );
+	printf( "\t\t density of the input points, for about %s samples per finest node. If that\n" ,
+			SamplesPerNode.name() );
+	printf( "\t\t is not given either, it is raised to match the density at the finest depth.\n" );
+	printf( "\t[--%s <peak memory budget of --%s, in MB>]\n" , MemoryBudget.name() , AutoDepth.name() );
+
+	printf( "\t[--%s <depth of the cells in which the samples are merged>]\n" , MergeDepth.name() );
+	printf( "\t\t The samples falling into the same cell at this depth are replaced by their\n" );
+	printf( "\t\t average position and normal, weighted by their count, before splatting.\n" );
+
 	printf( "\t[--%s <depth at which to extract the voxel grid>=<%s>]\n" , VoxelDepth.name() , Depth.name() );
+	printf( "\t[--%s <comma-separated depths of additional meshes>]\n" , LODDepths.name() );
+	printf( "\t\t The solution truncated to each depth is meshed and written next to the\n" );
+	printf( "\t\t output mesh, with \".d<depth>\" inserted before the extension.\n" );
+	printf( "\t[--%s <width of the sparse voxel grid band, in voxels>=%d]\n" , VoxelBand.name() , VoxelBand.value() );
+	printf( "\t[--%s]\n" , EstimateOnly.name() );
+	printf( "\t\t Only sets up the tree two depths coarser, replays its refinement at the requested\n" );
+	printf( "\t\t depth on the cells of the points and reports the node and matrix entry counts per\n" );
+	printf( "\t\t depth, with estimates of the solve time, peak memory and temporary mesh file size.\n" );
+	printf( "\t[--%s <comma-separated files of additional points>]\n" , Append.name() );
+	printf( "\t\t Each file is splatted into the tree in turn, the system is re-solved near the\n" );
+	printf( "\t\t new points only and the part of the iso-surface that changed is written, at the\n" );
+	printf( "\t\t iso-value of the output mesh, next to it with \".a<index>\" inserted before the\n" );
+	printf( "\t\t extension.\n" );
 
 	printf( "\t[--%s <scale factor>=%f]\n" , Scale.name() , Scale.value() );
 	printf( "\t\t Specifies the factor of the bounding cube that the input\n" );
@@ -174,6 +234,11 @@ void ShowUsage(std::string const& executable) {
 	printf( "\t\t is output after the reconstruction.\n" );
 #endif // _WIN32
 	printf( "\t[--%s]\n" , Density.name() );
+	printf( "\t[--%s <trimming value>]\n" , Trim.name() );
+	printf( "\t\t If this value is set, the output meshes are trimmed to the part where the\n" );
+	printf( "\t\t density is above it, as SurfaceTrimmer would, without writing the full mesh.\n" );
+	printf( "\t[--%s <smoothing iterations>=%d]\n" , Smooth.name() , Smooth.value() );
+	printf( "\t[--%s <relative area of islands>=%f]\n" , IslandAreaRatio.name() , IslandAreaRatio.value() );
 	printf( "\t[--%s]\n" , ASCII.name() );
 	printf( "\t\t If this flag is enabled, the output file is written out in ASCII format.\n" );
 	printf( "\t[--%s]\n" , NoComments.name() );
@@ -183,7 +248,7 @@ void ShowUsage(std::string const& executable) {
 }
 
 int ValidateFlags(std::string const& executable) {
-	DumpOutput::instance().setEchoStdout(Verbose.set());
+	DumpOutput::instance().setEchoStdout(Verbose.set() || EstimateOnly.set());
 	DumpOutput::instance().setNoComments(NoComments.set());
 
 	if(!In.set()) {
@@ -191,6 +256,39 @@ int ValidateFlags(std::string const& executable) {
 		return EXIT_FAILURE;
 	}
 
+	if(Evaluate.set() != EvaluateOut.set()) {
+		std::cerr << "[ERROR] " << Evaluate.name() << " and " << EvaluateOut.name() <<
+			" must be set together" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if(RegionOfInterest.set() && RegionOfInterest.value().size() != 6) {
+		std::cerr << "[ERROR] " << RegionOfInterest.name() << " expects 6 comma-separated values: " <<
+			RegionOfInterest.toString() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if(LODDepths.set() && !Out.set()) {
+		std::cerr << "[ERROR] " << LODDepths.name() << " requires " << Out.name() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if(Append.set() && !Out.set()) {
+		std::cerr << "[ERROR] " << Append.name() << " requires " << Out.name() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if(Trim.set() && !Out.set()) {
+		std::cerr << "[ERROR] " << Trim.name() << " requires " << Out.name() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if(Append.set() && LODDepths.set()) {
+		std::cerr << "[ERROR] " << Append.name() << " and " << LODDepths.name() << " cannot be used together" <<
+			std::endl;
+		return EXIT_FAILURE;
+	}
+
 	if(!MaxSolveDepth.set()) MaxSolveDepth.value() = Depth.value();
 
 	if(SolverDivide.value() < MinDepth.value()) {
@@ -217,6 +315,42 @@ int ValidateFlags(std::string const& executable) {
 	return EXIT_SUCCESS;
 }
 
+std::string SuffixedFileName(std::string const& fileName, char tag, int index) {
+	std::stringstream ss;
+	size_t last_dot = fileName.find_last_of('.');
+	size_t last_slash = fileName.find_last_of("/\\");
+	if(last_dot == std::string::npos || (last_slash != std::string::npos && last_dot < last_slash))
+		ss << fileName << "." << tag << index;
+	else ss << fileName.substr(0, last_dot) << "." << tag << index << fileName.substr(last_dot);
+	return ss.str();
+}
+
+template<class Vertex>
+void WriteMesh(std::string const& fileName, CoredFileMeshData<Vertex>& mesh, XForm<Real, 4> const& xForm) {
+	PlyWritePolygons(fileName.c_str(), &mesh, ASCII.set() ? PLY_ASCII : PLY_BINARY_NATIVE,
+			DumpOutput::instance().strings(), xForm.inverse());
+}
+
+// With the density, the mesh can be trimmed in memory before it is written
+void WriteMesh(std::string const& fileName, CoredFileMeshData<PlyValueVertex<Real> >& mesh,
+		XForm<Real, 4> const& xForm) {
+	if(!Trim.set()) return WriteMesh<PlyValueVertex<Real> >(fileName, mesh, xForm);
+
+	double t = Time();
+	std::vector<PlyValueVertex<Real> > vertices;
+	PolygonList polygons;
+	mesh.getMesh(vertices, polygons);
+	XForm<Real, 4> iXForm = xForm.inverse();
+#pragma omp parallel for num_threads(Threads.value())
+	for(int i = 0; i < (int)vertices.size(); ++i) vertices[i] = iXForm * vertices[i];
+	SmoothValues(vertices, polygons, Smooth.value(), Threads.value());
+	TrimSurface(vertices, polygons, (Real)Trim.value(), (Real)IslandAreaRatio.value(), PolygonMesh.set(),
+			Threads.value());
+	DumpOutput::instance()("#              Trimmed in: %9.1f (s)\n", Time() - t);
+	PlyWritePolygons(fileName, vertices, polygons, ASCII.set() ? PLY_ASCII : PLY_BINARY_NATIVE,
+			DumpOutput::instance().strings());
+}
+
 template<int Degree, class Real, class Vertex, bool OutputDensity>
 int Execute() {
 	DumpOutput::instance()("Running Screened Poisson Reconstruction (Version 5.71)\n");
@@ -238,19 +372,99 @@ int Execute() {
 	}
 	else xForm = XForm<Real, 4>::Identity();
 
+	// Read the query points up front, so that a malformed file is reported before solving
+	std::vector<Point3D<Real> > queries;
+	if(Evaluate.set() && !ReadPointPositions(Evaluate.value(), queries)) return EXIT_FAILURE;
+
+	if(AutoDepth.set()) {
+		double t = Time();
+		DepthSelection selection = Octree<Degree, OutputDensity>::SelectDepths(In.value(), xForm, Scale.value(),
+				SamplesPerNode.value(), (double)MemoryBudget.value() * (1 << 20), Threads.value());
+		if(!Depth.set()) Depth.value() = selection.maxDepth;
+		if(!KernelDepth.set()) KernelDepth.value() = std::min(selection.kernelDepth, Depth.value());
+		if(!MinDepth.set()) MinDepth.value() = std::min(selection.minDepth, Depth.value());
+		if(!SamplesPerNode.set()) SamplesPerNode.value() = selection.samplesPerNode;
+		if(!MaxSolveDepth.set()) MaxSolveDepth.value() = Depth.value();
+		SolverDivide.value() = std::max(SolverDivide.value(), MinDepth.value());
+		IsoDivide.value() = std::max(IsoDivide.value(), MinDepth.value());
+		DumpOutput::instance()("#       Depths picked in: %9.1f (s)\n", Time() - t);
+		for(int d = 1; d <= std::min(Depth.value() + 1, AUTO_DEPTH_MAX); ++d)
+			DumpOutput::instance()("#               Depth[%2d]: %10lld cells, %5.1f%% / %5.1f%% dense\n", d,
+					selection.cells[d], 100 * selection.denseFraction[d], 100 * selection.kernelDenseFraction[d]);
+		DumpOutput::instance()("#               Depth/Kernel/Min: %d/%d/%d\n", Depth.value(), KernelDepth.value(),
+				MinDepth.value());
+		DumpOutput::instance()("#               Samples per node: %g\n", SamplesPerNode.value());
+	}
+
 	OctNode<TreeNodeData<OutputDensity>, Real>::SetAllocator(MEMORY_ALLOCATOR_BLOCK_SIZE);
 
 	double tt = Time();
 
+	if(EstimateOnly.set()) {
+		// The tree is set up at a coarser depth (but no coarser than two past the minimum depth, short of which
+		// its leaves are too few to grow the mesh from), so that the estimate only takes a fraction of the
+		// memory of the run. The kernel and merge depths are kept, as they set the samples and the depths they
+		// are splatted at, unless the kernel is finer than the tree.
+		int depth = std::max(Depth.value() - ESTIMATE_DEPTH_DROP, std::min(MinDepth.value() + 2, Depth.value()));
+		Octree<Degree, OutputDensity> tree(Threads.value(), depth, getBoundaryType(BoundaryType.value()));
+		double t = Time();
+		tree.setTree(In.value(), depth, MinDepth.value(), std::min(KernelDepth.value(), depth),
+				SamplesPerNode.value(), Scale.value(), Confidence.set(), NormalWeights.set(), PointWeight.value(),
+				AdaptiveExponent.value(), xForm, false, MergeDepth.value());
+		tree.ClipTree();
+		tree.finalize(IsoDivide.value());
+		DumpOutput::instance()("#   Tree set at depth %2d in: %9.1f (s), %9.1f (MB)\n", depth, Time() - t,
+				tree.maxMemoryUsage());
+		t = Time();
+		ReconstructionEstimate estimate = tree.GetEstimate(In.value(), xForm, Depth.value(), MergeDepth.value(),
+				SolverDivide.value(), MinIters.value(), MaxSolveDepth.value(), FixedIters.value());
+		int firstDepth = Depth.value() - (int)estimate.nodes.size() + 1;
+		for(size_t i = 0; i != estimate.nodes.size(); ++i)
+			DumpOutput::instance()("#               Depth[%2d]: %10lld nodes, %12lld matrix entries\n",
+					firstDepth + (int)i, estimate.nodes[i], estimate.entries[i]);
+		DumpOutput::instance()("#   Node count replay off by %+.1f%% at depth %d\n", 100 * estimate.nodeError,
+				depth);
+		// The mesh of this tree is extracted and grown to the requested depth, without echoing the solver
+		DumpOutput::instance().setEchoStdout(false);
+		tree.SetLaplacianConstraints();
+		tree.LaplacianMatrixIteration(SolverDivide.value(), false, MinIters.value(), SolverAccuracy.value(),
+				MaxSolveDepth.value(), FixedIters.value());
+		DumpOutput::instance().setEchoStdout(true);
+		CoredFileMeshData<Vertex> mesh;
+		tree.GetMCIsoTriangles(tree.GetIsoValue(), IsoDivide.value(), &mesh, 1, !NonManifold.set(),
+				PolygonMesh.set());
+		double vertices = estimate.meshGrowth * (mesh.inCorePointCount() + mesh.outOfCorePointCount());
+		double polygons = estimate.meshGrowth * mesh.polygonCount();
+		double meshSize = vertices * sizeof(Vertex) + polygons * (sizeof(int) + 3 * sizeof(CoredVertexIndex));
+		DumpOutput::instance()("#   Estimated vertices: %.0f to %.0f\n", ESTIMATE_MESH_LOW * vertices,
+				ESTIMATE_MESH_HIGH * vertices);
+		DumpOutput::instance()("#   Estimated polygons: %.0f to %.0f\n", ESTIMATE_MESH_LOW * polygons,
+				ESTIMATE_MESH_HIGH * polygons);
+		DumpOutput::instance()("#   Estimated mesh temp files: %.1f to %.1f (MB)\n",
+				ESTIMATE_MESH_LOW * meshSize / (1 << 20), ESTIMATE_MESH_HIGH * meshSize / (1 << 20));
+		DumpOutput::instance()("#   Estimated peak memory: %.1f to %.1f (MB)\n",
+				ESTIMATE_MEMORY_LOW * estimate.peakMemory / (1 << 20),
+				ESTIMATE_MEMORY_HIGH * estimate.peakMemory / (1 << 20));
+		DumpOutput::instance()("#   Estimated solve time: %.1f to %.1f (s)\n",
+				ESTIMATE_TIME_LOW * estimate.solveTime, ESTIMATE_TIME_HIGH * estimate.solveTime);
+		DumpOutput::instance()("#             Estimated in: %9.1f (s)\n", Time() - t);
+		return EXIT_SUCCESS;
+	}
+
 	Octree<Degree, OutputDensity> tree(Threads.value(), Depth.value(), getBoundaryType(BoundaryType.value()));
 
 	double t = Time();
 	tree.resetMaxMemoryUsage();
 	int pointCount = tree.setTree(In.value(), Depth.value(), MinDepth.value(), KernelDepth.value(),
 			SamplesPerNode.value(), Scale.value(), Confidence.set(), NormalWeights.set(), PointWeight.value(),
-			AdaptiveExponent.value(), xForm);
+			AdaptiveExponent.value(), xForm, Append.set(), MergeDepth.value());
 	tree.ClipTree();
 	tree.finalize(IsoDivide.value());
+	if(RegionOfInterest.set()) {
+		std::vector<float> const& roi = RegionOfInterest.value();
+		tree.SetRegionOfInterest(Point3D<Real>(roi[0], roi[1], roi[2]), Point3D<Real>(roi[3], roi[4], roi[5]),
+				xForm);
+	}
 
 	DumpOutput::instance()("#             Tree set in: %9.1f (s), %9.1f (MB)\n", Time() - t,
 			tree.maxMemoryUsage());
@@ -260,6 +474,7 @@ int Execute() {
 	DumpOutput::instance()("#               Memory Usage: %.3f MB\n",
 			float(MemoryInfo::Usage()) / (1 << 20));
 
+
 	double maxMemoryUsage = tree.maxMemoryUsage();
 	t = Time();
 	tree.resetMaxMemoryUsage();
@@ -300,6 +515,52 @@ int Execute() {
 		DumpOutput::instance()("#       Got voxel grid in: %f\n" , Time()-t );
 	}
 
+	if(SparseVoxel.set()) {
+		double t = Time();
+		std::ofstream file(SparseVoxel.value().c_str(), std::ofstream::out | std::ofstream::binary);
+		if(!file) std::cerr << "Failed to open voxel file for writing: " << SparseVoxel.value() << std::endl;
+		else {
+			SparseVoxelGrid grid = tree.GetSparseSolutionGrid(isoValue, VoxelDepth.value(), VoxelBand.value());
+			int blockCount = grid.blockCount();
+			file.write(reinterpret_cast<char*>(&grid.res), sizeof(grid.res));
+			file.write(reinterpret_cast<char*>(&grid.blockRes), sizeof(grid.blockRes));
+			file.write(reinterpret_cast<char*>(&blockCount), sizeof(blockCount));
+			if(blockCount)
+				file.write(reinterpret_cast<char*>(&grid.blocks[0]), grid.blocks.size() * sizeof(int));
+			for(size_t i = 0; i != grid.values.size(); ++i) {
+				float v = (float)grid.values[i];
+				file.write(reinterpret_cast<char*>(&v), sizeof(v));
+			}
+			DumpOutput::instance()("#          Voxel blocks: %d / %d\n", blockCount,
+					(grid.res / grid.blockRes) * (grid.res / grid.blockRes) * (grid.res / grid.blockRes));
+		}
+		DumpOutput::instance()("# Got sparse voxel grid in: %f\n" , Time()-t );
+	}
+
+	if(Evaluate.set()) {
+		double t = Time();
+		std::vector<Real> values;
+		std::vector<Point3D<Real> > gradients;
+		tree.GetSolutionValues(queries, xForm, isoValue, values, Gradients.set() ? &gradients : nullptr);
+		std::ofstream file(EvaluateOut.value().c_str(), ASCII.set() ? std::ofstream::out :
+				std::ofstream::out | std::ofstream::binary);
+		if(!file) std::cerr << "Failed to open values file for writing: " << EvaluateOut.value() << std::endl;
+		else {
+			for(size_t i = 0; i != values.size(); ++i) {
+				float v[] = { (float)values[i], 0, 0, 0 };
+				if(Gradients.set())
+					for(int j = 0; j != 3; ++j) v[j + 1] = (float)gradients[i][j];
+				int n = Gradients.set() ? 4 : 1;
+				if(ASCII.set()) {
+					for(int j = 0; j != n; ++j) file << (j ? " " : "") << v[j];
+					file << "\n";
+				} else file.write(reinterpret_cast<char*>(v), n * sizeof(float));
+			}
+		}
+		DumpOutput::instance()("#          Query Points: %d\n", (int)queries.size());
+		DumpOutput::instance()("#    Evaluated points in: %f\n", Time() - t);
+	}
+
 	if(Out.set()) {
 		t = Time();
 		CoredFileMeshData<Vertex> mesh;
@@ -316,8 +577,41 @@ int Execute() {
 		DumpOutput::instance()("#             Total Solve: %9.1f (s), %9.1f (MB)\n", Time() - tt,
 				maxMemoryUsage);
 
-		PlyWritePolygons(Out.value().c_str(), &mesh, ASCII.set() ? PLY_ASCII : PLY_BINARY_NATIVE,
-				DumpOutput::instance().strings(), xForm.inverse());
+		WriteMesh(Out.value(), mesh, xForm);
+	}
+
+	for(size_t i = 0; i != Append.value().size(); ++i) {
+		t = Time();
+		int count = tree.AppendPoints(Append.value()[i], xForm, IsoDivide.value());
+		tree.SetLaplacianConstraints();
+		tree.LaplacianMatrixIteration(SolverDivide.value(), ShowResidual.set(), MinIters.value(),
+				SolverAccuracy.value(), MaxSolveDepth.value(), FixedIters.value());
+		// The iso-value of the output mesh is kept so that the patch lines up with it
+		CoredFileMeshData<Vertex> mesh;
+		tree.GetMCIsoTriangles(isoValue, IsoDivide.value(), &mesh, 1, !NonManifold.set(), PolygonMesh.set());
+		DumpOutput::instance()("#   Appended %9d points in: %9.1f (s)\n", count, Time() - t);
+		WriteMesh(SuffixedFileName(Out.value(), 'a', (int)i + 1), mesh, xForm);
+	}
+
+	if(LODDepths.set()) {
+		// Truncating the tree is destructive, so go from the finest to the coarsest depth
+		std::vector<int> depths = LODDepths.value();
+		std::sort(depths.begin(), depths.end(), std::greater<int>());
+		depths.erase(std::unique(depths.begin(), depths.end()), depths.end());
+		for(size_t i = 0; i != depths.size(); ++i) {
+			if(depths[i] > Depth.value() || depths[i] <= 0) {
+				std::cerr << "[WARNING] Skipping level of detail outside of (0, " << Depth.value() << "]: " <<
+					depths[i] << std::endl;
+				continue;
+			}
+			t = Time();
+			tree.TruncateTree(depths[i]);
+			CoredFileMeshData<Vertex> mesh;
+			tree.GetMCIsoTriangles(isoValue, IsoDivide.value(), &mesh, 1, !NonManifold.set(),
+					PolygonMesh.set());
+			DumpOutput::instance()("#   Got depth %2d mesh in: %9.1f (s)\n", depths[i], Time() - t);
+			WriteMesh(SuffixedFileName(Out.value(), 'd', depths[i]), mesh, xForm);
+		}
 	}
 
 	return EXIT_SUCCESS;
@@ -337,7 +631,7 @@ int main(int argc, char** argv) {
 	cmdLineParse(argc - 1, argv + 1, params);
 	int ret;
 	if((ret = ValidateFlags(argv[0]))) return ret;
-	ret = Density.set() ? Execute<2, Real, PlyValueVertex<Real>, true>() :
+	ret = Density.set() || Trim.set() ? Execute<2, Real, PlyValueVertex<Real>, true>() :
 		Execute<2, Real, PlyVertex<Real>, false>();
 #ifdef _WIN32
 	if( Performance.set() )
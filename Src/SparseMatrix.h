@@ -69,6 +69,12 @@ public:
 
 	T Norm(size_t Ln) const;
 
+	// Copies the rows and columns with index[i] >= 0 into M, row i becoming row index[i] of the rows there.
+	// The entries coupling them to the other rows move their products with x to the right-hand side b.
+	template<class T2>
+	void Restrict(std::vector<int> const& index, int rows, Vector<T2> const& b, Vector<T2> const& x,
+			SparseSymmetricMatrix& M, Vector<T2>& _b) const;
+
 	template<class T2>
 	static int Solve(SparseSymmetricMatrix<T> const& M, Vector<T2> const& b, int iters, Vector<T2>& solution,
 			T2 eps, bool reset, int threads, bool addDCTerm);
@@ -43,6 +43,34 @@ Vector<T2> SparseSymmetricMatrix<T>::operator*(Vector<T2> const& V) const {
 	return R;
 }
 
+template<class T>
+template<class T2>
+void SparseSymmetricMatrix<T>::Restrict(std::vector<int> const& index, int rows, Vector<T2> const& b,
+		Vector<T2> const& x, SparseSymmetricMatrix& M, Vector<T2>& _b) const {
+	M.Resize(rows);
+	_b = Vector<T2>(rows);
+	for(int i = 0; i != Rows(); ++i)
+		if(index[i] >= 0) _b[index[i]] = b[i];
+	// Each stored entry stands for both M[i][N] and M[N][i]
+	for(int i = 0; i != Rows(); ++i) {
+		int count = 0;
+		for(int ii = 0; ii != rowSizes_[i]; ++ii) {
+			MatrixEntry<T> const& e = m_ppElements[i][ii];
+			if(index[i] >= 0 && index[e.N] >= 0) ++count;
+			else if(index[i] >= 0) _b[index[i]] -= e.Value * x[e.N];
+			else if(index[e.N] >= 0) _b[index[e.N]] -= e.Value * x[i];
+		}
+		if(index[i] < 0) continue;
+		M.SetRowSize(index[i], count);
+		M.rowSize(index[i]) = count;
+		count = 0;
+		for(int ii = 0; ii != rowSizes_[i]; ++ii) {
+			MatrixEntry<T> const& e = m_ppElements[i][ii];
+			if(index[e.N] >= 0) M.at(index[i], count++) = MatrixEntry<T>(index[e.N], e.Value);
+		}
+	}
+}
+
 template<class T>
 template<class T2>
 void SparseSymmetricMatrix<T>::Multiply(Vector<T2> const& in, Vector<T2>& out, bool addDCTerm,
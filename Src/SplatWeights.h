@@ -0,0 +1,85 @@
+#pragma once
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "Geometry.h"
+
+// The separable weights that a sample gives to the 3x3x3 nodes around a node: dx[axis][tap] along
+// each axis, and their outer product, stored with a row of four (the last zero) per pair of taps along
+// the first two axes so that each row is one or two vector operations.
+class SplatWeights {
+public:
+	double dx[3][3];
+	double w[9][4];
+
+	// The quadratic B-spline weights of the sample at position in the node of the given center and width
+	template<class Real>
+	void setQuadratic(Point3D<Real> const& center, double width, Point3D<Real> const& position) {
+		for(int i = 0; i != 3; ++i) {
+			double x = (center[i] - position[i] - width) / width;
+			dx[i][0] = 1.125 + 1.5 * x + 0.5 * x * x;
+			x = (center[i] - position[i]) / width;
+			dx[i][1] = 0.75 - x * x;
+			dx[i][2] = 1 - dx[i][1] - dx[i][0];
+		}
+	}
+
+	// Sets w[3 * i + j][k] to dx[0][i] * dx[1][j] * scale * dx[2][k]
+	void outerProduct(double scale = 1) {
+#if defined(__AVX2__)
+		__m256d z = _mm256_set_pd(0, dx[2][2], dx[2][1], dx[2][0]);
+		for(int i = 0; i != 3; ++i)
+			for(int j = 0; j != 3; ++j)
+				_mm256_storeu_pd(w[3 * i + j],
+						_mm256_mul_pd(_mm256_set1_pd(dx[0][i] * dx[1][j] * scale), z));
+#elif defined(__SSE2__)
+		__m128d z01 = _mm_set_pd(dx[2][1], dx[2][0]);
+		__m128d z2 = _mm_set_pd(0, dx[2][2]);
+		for(int i = 0; i != 3; ++i)
+			for(int j = 0; j != 3; ++j) {
+				__m128d xy = _mm_set1_pd(dx[0][i] * dx[1][j] * scale);
+				_mm_storeu_pd(w[3 * i + j], _mm_mul_pd(xy, z01));
+				_mm_storeu_pd(w[3 * i + j] + 2, _mm_mul_pd(xy, z2));
+			}
+#else
+		for(int i = 0; i != 3; ++i)
+			for(int j = 0; j != 3; ++j) {
+				double xy = dx[0][i] * dx[1][j] * scale;
+				for(int k = 0; k != 3; ++k) w[3 * i + j][k] = xy * dx[2][k];
+				w[3 * i + j][3] = 0;
+			}
+#endif
+	}
+
+	// The sum of the weights times the values of the nodes, laid out as the weights with the last value of
+	// each row zero
+	double contract(double const values[9][4]) const {
+#if defined(__AVX2__)
+		__m256d sum = _mm256_setzero_pd();
+		for(int r = 0; r != 9; ++r)
+			sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_loadu_pd(w[r]), _mm256_loadu_pd(values[r])));
+		__m128d half = _mm_add_pd(_mm256_castpd256_pd128(sum), _mm256_extractf128_pd(sum, 1));
+		return _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+#elif defined(__SSE2__)
+		__m128d sum01 = _mm_setzero_pd();
+		__m128d sum2 = _mm_setzero_pd();
+		for(int r = 0; r != 9; ++r) {
+			sum01 = _mm_add_pd(sum01, _mm_mul_pd(_mm_loadu_pd(w[r]), _mm_loadu_pd(values[r])));
+			sum2 = _mm_add_sd(sum2, _mm_mul_sd(_mm_load_sd(w[r] + 2), _mm_load_sd(values[r] + 2)));
+		}
+		sum01 = _mm_add_pd(sum01, sum2);
+		return _mm_cvtsd_f64(_mm_add_sd(sum01, _mm_unpackhi_pd(sum01, sum01)));
+#else
+		double sum = 0;
+		for(int r = 0; r != 9; ++r)
+			for(int k = 0; k != 3; ++k) sum += w[r][k] * values[r][k];
+		return sum;
+#endif
+	}
+
+	double operator()(int i, int j, int k) const { return w[3 * i + j][k]; }
+};
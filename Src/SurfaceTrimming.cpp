@@ -0,0 +1,234 @@
+/*
+Copyright (c) 2013, Michael Kazhdan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list of
+conditions and the following disclaimer. Redistributions in binary form must reproduce
+the above copyright notice, this list of conditions and the following disclaimer
+in the documentation and/or other materials provided with the distribution. 
+
+Neither the name of the Johns Hopkins University nor the names of its contributors
+may be used to endorse or promote products derived from this software without specific
+prior written permission. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+TO, PROCUREMENT OF SUBSTITUTE  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+DAMAGE.
+*/
+
+#ifdef WIN32
+#include <Windows.h>
+#endif // WIN32
+
+#include "SurfaceTrimming.h"
+#include "Util.h"
+
+long long EdgeKey(long long key1, long long key2) {
+	return key1 <= key2 ? (key1 << 32) | key2 : EdgeKey(key2, key1);
+}
+
+void SetVertexAdjacency(size_t vCount, PolygonList const& polygons, PolygonList& adjacency) {
+	adjacency.offsets.assign(vCount + 1, 0);
+	for(size_t i = 0; i != polygons.size(); ++i) {
+		int const* polygon = polygons[i];
+		int sz = polygons.polygonSize(i);
+		for(int j = 0; j != sz; ++j) {
+			++adjacency.offsets[polygon[j] + 1];
+			++adjacency.offsets[polygon[(j + 1) % sz] + 1];
+		}
+	}
+	for(size_t i = 0; i != vCount; ++i) adjacency.offsets[i + 1] += adjacency.offsets[i];
+	adjacency.indices.resize(adjacency.offsets[vCount]);
+	std::vector<size_t> next(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+	for(size_t i = 0; i != polygons.size(); ++i) {
+		int const* polygon = polygons[i];
+		int sz = polygons.polygonSize(i);
+		for(int j = 0; j != sz; ++j) {
+			int v1 = polygon[j];
+			int v2 = polygon[(j + 1) % sz];
+			adjacency.indices[next[v1]++] = v2;
+			adjacency.indices[next[v2]++] = v1;
+		}
+	}
+}
+
+void SetCrossingEdges(PolygonList const& polygons, std::vector<char> const& gt, std::vector<long long>& keys,
+		int threads) {
+	int chunks = std::max(threads, 1);
+	std::vector<size_t> bounds(chunks + 1);
+	for(int c = 0; c <= chunks; ++c) bounds[c] = polygons.size() * c / chunks;
+	std::vector<size_t> counts(chunks + 1, 0);
+#pragma omp parallel for num_threads(threads)
+	for(int c = 0; c < chunks; ++c)
+		for(size_t i = bounds[c]; i != bounds[c + 1]; ++i) {
+			int const* polygon = polygons[i];
+			int sz = polygons.polygonSize(i);
+			for(int j = 0; j != sz; ++j)
+				if(gt[polygon[j]] != gt[polygon[(j + 1) % sz]]) ++counts[c + 1];
+		}
+	for(int c = 0; c != chunks; ++c) counts[c + 1] += counts[c];
+	keys.resize(counts[chunks]);
+#pragma omp parallel for num_threads(threads)
+	for(int c = 0; c < chunks; ++c) {
+		size_t count = counts[c];
+		for(size_t i = bounds[c]; i != bounds[c + 1]; ++i) {
+			int const* polygon = polygons[i];
+			int sz = polygons.polygonSize(i);
+			for(int j = 0; j != sz; ++j) {
+				int v1 = polygon[j];
+				int v2 = polygon[(j + 1) % sz];
+				if(gt[v1] != gt[v2]) keys[count++] = EdgeKey(v1, v2);
+			}
+		}
+	}
+	ParallelSort(keys, threads);
+	keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+}
+
+// The vertices on the crossing edges follow the vCount input vertices, in the order of the edge keys
+static int EdgeVertex(std::vector<long long> const& keys, int vCount, int v1, int v2) {
+	return vCount + (int)(std::lower_bound(keys.begin(), keys.end(), EdgeKey(v1, v2)) - keys.begin());
+}
+
+void SplitPolygon(int const* polygon, int sz, std::vector<char> const& gt, std::vector<long long> const& keys,
+		int vCount, PolygonList& ltPolygons, PolygonList& gtPolygons, std::vector<char>& ltFlags,
+		std::vector<char>& gtFlags, std::vector<int>& poly) {
+	int gtCount = 0;
+	for(int j = 0; j != sz; ++j)
+		if(gt[polygon[j]]) ++gtCount;
+	if(gtCount == sz) {
+		gtPolygons.push_back(polygon, sz);
+		gtFlags.push_back(false);
+	} else if(gtCount == 0) {
+		ltPolygons.push_back(polygon, sz);
+		ltFlags.push_back(false);
+	} else {
+		int start;
+		for(start = 0; start != sz; ++start)
+			if(gt[polygon[start]] && !gt[polygon[(start + sz - 1) % sz]]) break;
+
+		bool gtFlag = true;
+		poly.clear();
+
+		// Add the initial vertex
+		poly.push_back(EdgeVertex(keys, vCount, polygon[(start + sz - 1) % sz], polygon[start]));
+
+		for(int _j = 0; _j <= sz; ++_j) {
+			int j1 = (_j + start + sz - 1) % sz;
+			int j2 = (_j + start) % sz;
+			int v1 = polygon[j1];
+			int v2 = polygon[j2];
+			if((gt[v2] != 0) == gtFlag) poly.push_back(v2);
+			else {
+				int vIdx = EdgeVertex(keys, vCount, v1, v2);
+				poly.push_back(vIdx);
+				if(gtFlag) {
+					gtPolygons.push_back(&poly[0], poly.size());
+					ltFlags.push_back(true);
+				} else {
+					ltPolygons.push_back(&poly[0], poly.size());
+					gtFlags.push_back(true);
+				}
+				poly.clear();
+				poly.push_back(vIdx);
+				poly.push_back(v2);
+				gtFlag = !gtFlag;
+			}
+		}
+	}
+}
+
+void AppendPolygons(std::vector<PolygonList> const& lists, PolygonList& polygons, int threads) {
+	std::vector<size_t> pCounts(lists.size() + 1, 0);
+	std::vector<size_t> iCounts(lists.size() + 1, 0);
+	for(size_t c = 0; c != lists.size(); ++c) {
+		pCounts[c + 1] = pCounts[c] + lists[c].size();
+		iCounts[c + 1] = iCounts[c] + lists[c].indices.size();
+	}
+	polygons.offsets.resize(pCounts.back() + 1);
+	polygons.indices.resize(iCounts.back());
+	polygons.offsets[0] = 0;
+#pragma omp parallel for num_threads(threads)
+	for(int c = 0; c < (int)lists.size(); ++c) {
+		std::copy(lists[c].indices.begin(), lists[c].indices.end(), polygons.indices.begin() + iCounts[c]);
+		for(size_t i = 0; i != lists[c].size(); ++i)
+			polygons.offsets[pCounts[c] + i + 1] = iCounts[c] + lists[c].offsets[i + 1];
+	}
+}
+
+static bool CompareAndSwap(volatile int* value, int oldValue, int newValue) {
+#ifdef WIN32
+	return InterlockedCompareExchange((volatile long*)value, newValue, oldValue) == oldValue;
+#else
+	return __sync_bool_compare_and_swap(value, oldValue, newValue);
+#endif
+}
+
+// A parent always has a smaller index than its children, so the root of a set is its smallest element
+// whatever the order of the unions. Paths are halved on the way up.
+static int FindRoot(volatile int* parents, int p) {
+	while(true) {
+		int q = parents[p];
+		if(q == p) return p;
+		int r = parents[q];
+		if(r != q) CompareAndSwap(&parents[p], q, r);
+		p = q;
+	}
+}
+
+static void Union(volatile int* parents, int p, int q) {
+	while(true) {
+		p = FindRoot(parents, p);
+		q = FindRoot(parents, q);
+		if(p == q) return;
+		if(p < q) std::swap(p, q);
+		if(CompareAndSwap(&parents[p], p, q)) return;
+	}
+}
+
+void SetConnectedComponents(PolygonList const& polygons, PolygonList& components, int threads) {
+	int pCount = polygons.size();
+	std::vector<std::pair<long long, int> > edges(polygons.indices.size());
+#pragma omp parallel for num_threads(threads)
+	for(int i = 0; i < pCount; ++i) {
+		int const* polygon = polygons[i];
+		int sz = polygons.polygonSize(i);
+		for(int j = 0; j != sz; ++j)
+			edges[polygons.offsets[i] + j] = std::make_pair(EdgeKey(polygon[j], polygon[(j + 1) % sz]), i);
+	}
+	ParallelSort(edges, threads);
+
+	std::vector<int> parents(pCount);
+	for(int i = 0; i != pCount; ++i) parents[i] = i;
+	if(pCount) {
+		volatile int* _parents = &parents[0];
+#pragma omp parallel for num_threads(threads)
+		for(int k = 1; k < (int)edges.size(); ++k)
+			if(edges[k].first == edges[k - 1].first) Union(_parents, edges[k - 1].second, edges[k].second);
+#pragma omp parallel for num_threads(threads)
+		for(int i = 0; i < pCount; ++i) parents[i] = FindRoot(_parents, i);
+	}
+	std::vector<std::pair<long long, int> >().swap(edges);
+
+	// Number the roots, and bucket the polygons by component
+	std::vector<int> cMap(pCount);
+#pragma omp parallel for num_threads(threads)
+	for(int i = 0; i < pCount; ++i) cMap[i] = parents[i] == i;
+	int cCount = ParallelRank(cMap, cMap.size(), threads);
+	components.offsets.assign(cCount + 1, 0);
+	for(int i = 0; i != pCount; ++i) ++components.offsets[cMap[parents[i]] + 1];
+	for(int c = 0; c != cCount; ++c) components.offsets[c + 1] += components.offsets[c];
+	components.indices.resize(pCount);
+	std::vector<size_t> next(components.offsets.begin(), components.offsets.end() - 1);
+	for(int i = 0; i != pCount; ++i) components.indices[next[cMap[parents[i]]]++] = i;
+}
@@ -0,0 +1,96 @@
+/*
+Copyright (c) 2013, Michael Kazhdan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list of
+conditions and the following disclaimer. Redistributions in binary form must reproduce
+the above copyright notice, this list of conditions and the following disclaimer
+in the documentation and/or other materials provided with the distribution. 
+
+Neither the name of the Johns Hopkins University nor the names of its contributors
+may be used to endorse or promote products derived from this software without specific
+prior written permission. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+TO, PROCUREMENT OF SUBSTITUTE  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+DAMAGE.
+*/
+#pragma once
+
+#include <vector>
+
+#include "Geometry.h"
+#include "MAT.h"
+#include "Ply.h"
+#include "Util.h"
+
+// Trims a mesh whose vertices carry a value, such as the sampling density output by PoissonRecon, to the
+// part of it above a trimming value.
+
+long long EdgeKey(long long key1, long long key2);
+template<class Real>
+PlyValueVertex<Real> InterpolateVertices(PlyValueVertex<Real> const& v1, PlyValueVertex<Real> const& v2,
+		float value);
+
+// Lists the neighbors of each vertex, once for each polygon edge they share, in the order of the edges
+void SetVertexAdjacency(size_t vCount, PolygonList const& polygons, PolygonList& adjacency);
+// Each iteration replaces the value of a vertex by the average over it and its neighbors. The neighbors
+// are gathered in the order the edges were scattered before, so the result does not depend on the number
+// of threads.
+template<class Real>
+void SmoothValues(std::vector<PlyValueVertex<Real> >& vertices, PolygonList const& polygons, int iterations,
+		int threads);
+
+// Returns the sorted keys of the edges whose end-points are on either side of the trimming value
+void SetCrossingEdges(PolygonList const& polygons, std::vector<char> const& gt, std::vector<long long>& keys,
+		int threads);
+void SplitPolygon(int const* polygon, int sz, std::vector<char> const& gt, std::vector<long long> const& keys,
+		int vCount, PolygonList& ltPolygons, PolygonList& gtPolygons, std::vector<char>& ltFlags,
+		std::vector<char>& gtFlags, std::vector<int>& poly);
+// Concatenates the lists in order
+void AppendPolygons(std::vector<PolygonList> const& lists, PolygonList& polygons, int threads);
+// Splits the polygons along the trimming value, one chunk of polygons per thread. The vertices on the
+// crossing edges are added once each, and the pieces are listed in the order of the polygons, whatever the
+// number of threads. A flag is set for the pieces of polygons that were split.
+template<class Real>
+void SplitPolygons(PolygonList const& polygons, std::vector<PlyValueVertex<Real> >& vertices, Real trimValue,
+		PolygonList& ltPolygons, PolygonList& gtPolygons, std::vector<char>& ltFlags,
+		std::vector<char>& gtFlags, int threads);
+
+template<class Real>
+void Triangulate(std::vector<PlyValueVertex<Real> > const& vertices, PolygonList const& polygons,
+		PolygonList& triangles);
+template<class Vertex>
+void RemoveHangingVertices(std::vector<Vertex>& vertices, PolygonList& polygons);
+
+// Lists the polygons of each connected component, in the same layout as the polygons. Polygons sharing an
+// edge are found next to each other once the edges are sorted by key, and are joined in a lock-free
+// union-find. The components come in the order of their first polygon.
+void SetConnectedComponents(PolygonList const& polygons, PolygonList& components, int threads);
+template<class Real>
+double PolygonArea(std::vector<PlyValueVertex<Real> > const& vertices, int const* polygon, int sz);
+// Sets the area of each component, and whether it has a piece of a split polygon. The areas are summed in
+// the order of the polygons, whatever the number of threads.
+template<class Real>
+void SetComponentAreas(std::vector<PlyValueVertex<Real> > const& vertices, PolygonList const& polygons,
+		std::vector<char> const& flags, PolygonList const& components, std::vector<double>& areas,
+		std::vector<char>& componentFlags, int threads);
+
+// Replaces the polygons by the part of the mesh above trimValue, without the islands smaller than
+// islandAreaRatio times the area of the mesh, and triangulated unless polygonMesh is set. The vertices
+// that are left unused are removed.
+template<class Real>
+void TrimSurface(std::vector<PlyValueVertex<Real> >& vertices, PolygonList& polygons, Real trimValue,
+		Real islandAreaRatio, bool polygonMesh, int threads);
+
+#include "SurfaceTrimming.inl"
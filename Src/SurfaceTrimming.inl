@@ -0,0 +1,229 @@
+/*
+Copyright (c) 2013, Michael Kazhdan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list of
+conditions and the following disclaimer. Redistributions in binary form must reproduce
+the above copyright notice, this list of conditions and the following disclaimer
+in the documentation and/or other materials provided with the distribution. 
+
+Neither the name of the Johns Hopkins University nor the names of its contributors
+may be used to endorse or promote products derived from this software without specific
+prior written permission. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+TO, PROCUREMENT OF SUBSTITUTE  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+DAMAGE.
+*/
+
+template<class Real>
+PlyValueVertex<Real> InterpolateVertices(PlyValueVertex<Real> const& v1, PlyValueVertex<Real> const& v2,
+		float value) {
+	if(v1.value == v2.value) return (v1 + v2) / (Real)2;
+
+	Real dx = (v1.value - value) / (v1.value - v2.value);
+	PlyValueVertex<Real> v;
+	for(int i = 0; i != 3; ++i) v.point.coords[i] = v1.point.coords[i] * (1 - dx) + v2.point.coords[i] * dx;
+	v.value = v1.value * (1 - dx) + v2.value * dx;
+	return v;
+}
+
+template<class Real>
+void SmoothValues(std::vector<PlyValueVertex<Real> >& vertices, PolygonList const& polygons, int iterations,
+		int threads) {
+	if(iterations <= 0 || polygons.indices.empty()) return;
+	PolygonList adjacency;
+	SetVertexAdjacency(vertices.size(), polygons, adjacency);
+	int vCount = vertices.size();
+	std::vector<Real> values(vCount);
+	std::vector<Real> smoothed(vCount);
+	for(int i = 0; i != vCount; ++i) values[i] = vertices[i].value;
+	for(int k = 0; k != iterations; ++k) {
+#pragma omp parallel for num_threads(threads)
+		for(int i = 0; i < vCount; ++i) {
+			int const* neighbors = &adjacency.indices[0] + adjacency.offsets[i];
+			int count = adjacency.polygonSize(i);
+			Real sum = 0;
+			for(int j = 0; j != count; ++j) sum += values[neighbors[j]];
+			smoothed[i] = (sum + values[i]) / (count + 1);
+		}
+		values.swap(smoothed);
+	}
+	for(int i = 0; i != vCount; ++i) vertices[i].value = values[i];
+}
+
+template<class Real>
+void SplitPolygons(PolygonList const& polygons, std::vector<PlyValueVertex<Real> >& vertices, Real trimValue,
+		PolygonList& ltPolygons, PolygonList& gtPolygons, std::vector<char>& ltFlags,
+		std::vector<char>& gtFlags, int threads) {
+	int vCount = vertices.size();
+	std::vector<char> gt(vCount);
+#pragma omp parallel for num_threads(threads)
+	for(int i = 0; i < vCount; ++i) gt[i] = vertices[i].value > trimValue;
+
+	std::vector<long long> keys;
+	SetCrossingEdges(polygons, gt, keys, threads);
+	vertices.resize(vCount + keys.size());
+#pragma omp parallel for num_threads(threads)
+	for(int k = 0; k < (int)keys.size(); ++k)
+		vertices[vCount + k] = InterpolateVertices(vertices[keys[k] >> 32], vertices[keys[k] & 0xffffffff],
+				trimValue);
+
+	int chunks = std::max(threads, 1);
+	std::vector<PolygonList> lt(chunks);
+	std::vector<PolygonList> gtp(chunks);
+	std::vector<std::vector<char> > ltf(chunks);
+	std::vector<std::vector<char> > gtf(chunks);
+#pragma omp parallel for num_threads(threads)
+	for(int c = 0; c < chunks; ++c) {
+		std::vector<int> poly;
+		for(size_t i = polygons.size() * c / chunks; i != polygons.size() * (c + 1) / chunks; ++i)
+			SplitPolygon(polygons[i], polygons.polygonSize(i), gt, keys, vCount, lt[c], gtp[c], ltf[c],
+					gtf[c], poly);
+	}
+	AppendPolygons(lt, ltPolygons, threads);
+	AppendPolygons(gtp, gtPolygons, threads);
+	ltFlags.clear();
+	gtFlags.clear();
+	for(int c = 0; c != chunks; ++c) {
+		ltFlags.insert(ltFlags.end(), ltf[c].begin(), ltf[c].end());
+		gtFlags.insert(gtFlags.end(), gtf[c].begin(), gtf[c].end());
+	}
+}
+
+template<class Real>
+void Triangulate(std::vector<PlyValueVertex<Real> > const& vertices, PolygonList const& polygons,
+		PolygonList& triangles) {
+	triangles.clear();
+	triangles.reserve(polygons.size(), 3 * polygons.size());
+	MinimalAreaTriangulation<Real> mat;
+	std::vector<Point3D<Real> > _vertices;
+	std::vector<TriangleIndex> _triangles;
+	for(size_t i = 0; i != polygons.size(); ++i) {
+		int const* polygon = polygons[i];
+		int sz = polygons.polygonSize(i);
+		if(sz > 3) {
+			_vertices.resize(sz);
+			for(int j = 0; j != sz; ++j) _vertices[j] = vertices[polygon[j]].point;
+			mat.GetTriangulation(_vertices, _triangles);
+
+			// Add the triangles to the mesh
+			for(size_t j = 0; j != _triangles.size(); ++j) {
+				int triangle[3];
+				for(int k = 0; k != 3; ++k) triangle[k] = polygon[_triangles[j].idx[k]];
+				triangles.push_back(triangle, 3);
+			}
+		} else if(sz == 3) triangles.push_back(polygon, 3);
+	}
+}
+
+template<class Vertex>
+void RemoveHangingVertices(std::vector<Vertex>& vertices, PolygonList& polygons) {
+	std::vector<int> vMap(vertices.size(), -1);
+	for(size_t i = 0; i != polygons.indices.size(); ++i) vMap[polygons.indices[i]] = 0;
+	int vCount = 0;
+	for(size_t i = 0; i != vertices.size(); ++i)
+		if(!vMap[i]) vMap[i] = vCount++;
+	for(size_t i = 0; i != polygons.indices.size(); ++i) polygons.indices[i] = vMap[polygons.indices[i]];
+
+	std::vector<Vertex> _vertices(vCount);
+	for(size_t i = 0; i != vertices.size(); ++i)
+		if(vMap[i] >= 0) _vertices[vMap[i]] = vertices[i];
+	vertices.swap(_vertices);
+}
+
+template<class Real>
+double PolygonArea(std::vector<PlyValueVertex<Real> > const& vertices, int const* polygon, int sz) {
+	if(sz < 3) return 0;
+	else if(sz == 3)
+		return TriangleArea(vertices[polygon[0]].point, vertices[polygon[1]].point,
+				vertices[polygon[2]].point);
+	else {
+		Point3D<Real> center;
+		for(int i = 0; i != sz; ++i)
+			center += vertices[polygon[i]].point;
+		center /= (Real)sz;
+		double area = 0;
+		for(int i = 0; i != sz; ++i)
+			area += TriangleArea(center, vertices[polygon[i]].point, vertices[polygon[(i + 1) % sz]].point);
+		return area;
+	}
+}
+
+template<class Real>
+void SetComponentAreas(std::vector<PlyValueVertex<Real> > const& vertices, PolygonList const& polygons,
+		std::vector<char> const& flags, PolygonList const& components, std::vector<double>& areas,
+		std::vector<char>& componentFlags, int threads) {
+	std::vector<double> pAreas(polygons.size());
+#pragma omp parallel for num_threads(threads)
+	for(int i = 0; i < (int)polygons.size(); ++i)
+		pAreas[i] = PolygonArea(vertices, polygons[i], polygons.polygonSize(i));
+	areas.assign(components.size(), 0);
+	componentFlags.assign(components.size(), 0);
+#pragma omp parallel for num_threads(threads)
+	for(int c = 0; c < (int)components.size(); ++c)
+		for(int j = 0; j != components.polygonSize(c); ++j) {
+			int p = components[c][j];
+			areas[c] += pAreas[p];
+			componentFlags[c] |= flags[p];
+		}
+}
+
+template<class Real>
+void TrimSurface(std::vector<PlyValueVertex<Real> >& vertices, PolygonList& polygons, Real trimValue,
+		Real islandAreaRatio, bool polygonMesh, int threads) {
+	PolygonList ltPolygons;
+	PolygonList gtPolygons;
+	std::vector<char> ltFlags;
+	std::vector<char> gtFlags;
+	SplitPolygons(polygons, vertices, trimValue, ltPolygons, gtPolygons, ltFlags, gtFlags, threads);
+	PolygonList().swap(polygons);
+
+	// Small islands below the value join the surface, and small islands above it are dropped
+	if(islandAreaRatio > 0) {
+		PolygonList _gtPolygons;
+		PolygonList ltComponents;
+		PolygonList gtComponents;
+		SetConnectedComponents(ltPolygons, ltComponents, threads);
+		SetConnectedComponents(gtPolygons, gtComponents, threads);
+		std::vector<double> ltAreas;
+		std::vector<double> gtAreas;
+		std::vector<char> ltComponentFlags;
+		std::vector<char> gtComponentFlags;
+		SetComponentAreas(vertices, ltPolygons, ltFlags, ltComponents, ltAreas, ltComponentFlags, threads);
+		SetComponentAreas(vertices, gtPolygons, gtFlags, gtComponents, gtAreas, gtComponentFlags, threads);
+		double area = 0;
+		for(size_t i = 0; i != ltAreas.size(); ++i) area += ltAreas[i];
+		for(size_t i = 0; i != gtAreas.size(); ++i) area += gtAreas[i];
+		for(size_t i = 0; i != ltComponents.size(); ++i) {
+			if(ltAreas[i] < area * islandAreaRatio && ltComponentFlags[i]) {
+				for(int j = 0; j != ltComponents.polygonSize(i); ++j) {
+					int p = ltComponents[i][j];
+					_gtPolygons.push_back(ltPolygons[p], ltPolygons.polygonSize(p));
+				}
+			}
+		}
+		for(size_t i = 0; i != gtComponents.size(); ++i) {
+			if(gtAreas[i] >= area * islandAreaRatio && gtComponentFlags[i]) {
+				for(int j = 0; j != gtComponents.polygonSize(i); ++j) {
+					int p = gtComponents[i][j];
+					_gtPolygons.push_back(gtPolygons[p], gtPolygons.polygonSize(p));
+				}
+			}
+		}
+		gtPolygons.swap(_gtPolygons);
+	}
+	if(polygonMesh) polygons.swap(gtPolygons);
+	else Triangulate(vertices, gtPolygons, polygons);
+	RemoveHangingVertices(vertices, polygons);
+}
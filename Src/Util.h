@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <vector>
 
 #ifndef CPP11
@@ -16,3 +17,39 @@ template<class T>
 void shrink_to_fit(std::vector<T>& v) {
 	std::vector<T>(v).swap(v);
 }
+
+// Sorts one chunk per thread and merges the sorted chunks pairwise
+template<class T>
+void ParallelSort(std::vector<T>& v, int threads) {
+	int chunks = std::max(threads, 1);
+	std::vector<size_t> bounds(chunks + 1);
+	for(int i = 0; i <= chunks; ++i) bounds[i] = v.size() * i / chunks;
+#pragma omp parallel for num_threads(threads)
+	for(int i = 0; i < chunks; ++i)
+		std::sort(v.begin() + bounds[i], v.begin() + bounds[i + 1]);
+	for(int width = 1; width < chunks; width *= 2)
+#pragma omp parallel for num_threads(threads)
+		for(int i = 0; i < chunks; i += 2 * width)
+			if(i + width < chunks)
+				std::inplace_merge(v.begin() + bounds[i], v.begin() + bounds[i + width],
+						v.begin() + bounds[std::min(i + 2 * width, chunks)]);
+}
+
+// Replaces the non-zero values among the first size ones by their rank and returns their count
+template<class T>
+T ParallelRank(std::vector<T>& v, size_t size, int threads) {
+	int chunks = std::max(threads, 1);
+	std::vector<T> counts(chunks + 1, 0);
+#pragma omp parallel for num_threads(threads)
+	for(int c = 0; c < chunks; ++c)
+		for(size_t i = size * c / chunks; i != size * (c + 1) / chunks; ++i)
+			if(v[i]) ++counts[c + 1];
+	for(int c = 0; c != chunks; ++c) counts[c + 1] += counts[c];
+#pragma omp parallel for num_threads(threads)
+	for(int c = 0; c < chunks; ++c) {
+		T count = counts[c];
+		for(size_t i = size * c / chunks; i != size * (c + 1) / chunks; ++i)
+			if(v[i]) v[i] = count++;
+	}
+	return counts[chunks];
+}
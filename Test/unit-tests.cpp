@@ -0,0 +1,242 @@
+// Checks the parallel helpers, and the connected components and trimming of SurfaceTrimming.h, against serial
+// references at several thread counts. Prints the failed checks and exits with a non-zero status if there
+// are any.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "SurfaceTrimming.h"
+#include "Util.h"
+
+static int const THREADS[] = { 1, 2, 3, 4, 7, 16 };
+static int const THREAD_COUNTS = sizeof(THREADS) / sizeof(THREADS[0]);
+static size_t const SIZES[] = { 0, 1, 5, 1000, 100003 };
+static int const SIZE_COUNTS = sizeof(SIZES) / sizeof(SIZES[0]);
+
+static int failures = 0;
+
+static void Check(bool passed, char const* test, size_t size, int threads) {
+	if(!passed) {
+		printf("FAILED: %s, size %lu, %d threads\n", test, (unsigned long)size, threads);
+		++failures;
+	}
+}
+
+// A fixed sequence of pseudo-random numbers, so that a failure can be reproduced
+static unsigned int seed = 1;
+static int Random(int range) {
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) % range;
+}
+
+// Values with many repeats, and pairs ordered on both members, as the edges of SetConnectedComponents
+static void TestParallelSort() {
+	for(int s = 0; s != SIZE_COUNTS; ++s) {
+		size_t size = SIZES[s];
+		std::vector<int> values(size);
+		std::vector<std::pair<long long, int> > pairs(size);
+		for(size_t i = 0; i != size; ++i) {
+			values[i] = Random(size / 4 + 1);
+			pairs[i] = std::make_pair((long long)Random(size / 2 + 1) << 32 | Random(1000), (int)i);
+		}
+		std::vector<int> sortedValues(values);
+		std::vector<std::pair<long long, int> > sortedPairs(pairs);
+		std::sort(sortedValues.begin(), sortedValues.end());
+		std::sort(sortedPairs.begin(), sortedPairs.end());
+		for(int t = 0; t != THREAD_COUNTS; ++t) {
+			std::vector<int> v(values);
+			ParallelSort(v, THREADS[t]);
+			Check(v == sortedValues, "ParallelSort of values", size, THREADS[t]);
+			std::vector<std::pair<long long, int> > p(pairs);
+			ParallelSort(p, THREADS[t]);
+			Check(p == sortedPairs, "ParallelSort of pairs", size, THREADS[t]);
+		}
+	}
+}
+
+// Only the first half of the values are ranked, and the rest must be left as they are
+static void TestParallelRank() {
+	for(int s = 0; s != SIZE_COUNTS; ++s) {
+		size_t size = SIZES[s];
+		std::vector<int> values(2 * size);
+		for(size_t i = 0; i != values.size(); ++i) values[i] = Random(3) ? 0 : 1 + Random(10);
+		std::vector<int> ranks(values);
+		int count = 0;
+		for(size_t i = 0; i != size; ++i)
+			if(ranks[i]) ranks[i] = count++;
+		for(int t = 0; t != THREAD_COUNTS; ++t) {
+			std::vector<int> v(values);
+			int c = ParallelRank(v, size, THREADS[t]);
+			Check(c == count, "ParallelRank count", size, THREADS[t]);
+			Check(v == ranks, "ParallelRank ranks", size, THREADS[t]);
+		}
+	}
+}
+
+// Adds a grid of quads, or of triangles, with its corner at (x, y). The value at a vertex is high on a
+// checkerboard of squares, so that trimming leaves islands of several sizes.
+static void AddGrid(std::vector<PlyValueVertex<float> >& vertices, PolygonList& polygons, float x, float y,
+		int width, int height, bool triangles) {
+	int v0 = vertices.size();
+	for(int j = 0; j <= height; ++j)
+		for(int i = 0; i <= width; ++i) {
+			float value = (i / 4 + j / 3) % 2 ? 1.f + 0.1f * (i % 4) : 0.1f * (j % 3);
+			vertices.push_back(PlyValueVertex<float>(Point3D<float>(x + i, y + j, 0.05f * i * j), value));
+		}
+	for(int j = 0; j != height; ++j)
+		for(int i = 0; i != width; ++i) {
+			int quad[4] = { v0 + j * (width + 1) + i, v0 + j * (width + 1) + i + 1,
+					v0 + (j + 1) * (width + 1) + i + 1, v0 + (j + 1) * (width + 1) + i };
+			if(triangles) {
+				int triangle[3] = { quad[0], quad[2], quad[3] };
+				polygons.push_back(quad, 3);
+				polygons.push_back(triangle, 3);
+			} else polygons.push_back(quad, 4);
+		}
+}
+
+// Grids of either kind, triangles that only share a vertex, and a fan of three triangles on one edge, with
+// the polygons shuffled so that the components are interleaved
+static void SetMesh(std::vector<PlyValueVertex<float> >& vertices, PolygonList& polygons) {
+	vertices.clear();
+	PolygonList ordered;
+	AddGrid(vertices, ordered, 0, 0, 40, 30, false);
+	AddGrid(vertices, ordered, 50, 0, 17, 23, true);
+	AddGrid(vertices, ordered, 0, 40, 1, 1, false);
+	int v0 = vertices.size();
+	for(int i = 0; i != 10; ++i)
+		vertices.push_back(PlyValueVertex<float>(Point3D<float>(80 + i % 5, 80 + i / 5, i), 0.2f * i));
+	int pair[2][3] = { { v0, v0 + 1, v0 + 2 }, { v0 + 3, v0, v0 + 4 } };
+	int fan[3][3] = { { v0 + 5, v0 + 6, v0 + 7 }, { v0 + 6, v0 + 5, v0 + 8 }, { v0 + 5, v0 + 6, v0 + 9 } };
+	for(int i = 0; i != 2; ++i) ordered.push_back(pair[i], 3);
+	for(int i = 0; i != 3; ++i) ordered.push_back(fan[i], 3);
+
+	std::vector<int> order(ordered.size());
+	for(size_t i = 0; i != order.size(); ++i) order[i] = i;
+	for(size_t i = order.size(); i > 1; --i) std::swap(order[i - 1], order[Random(i)]);
+	polygons.clear();
+	for(size_t i = 0; i != order.size(); ++i)
+		polygons.push_back(ordered[order[i]], ordered.polygonSize(order[i]));
+}
+
+// Walks the polygons across their shared edges, starting from each polygon not yet reached
+static void SetSerialComponents(PolygonList const& polygons, PolygonList& components) {
+	std::multimap<long long, int> edges;
+	for(size_t i = 0; i != polygons.size(); ++i)
+		for(int j = 0, sz = polygons.polygonSize(i); j != sz; ++j)
+			edges.insert(std::make_pair(EdgeKey(polygons[i][j], polygons[i][(j + 1) % sz]), (int)i));
+	components.clear();
+	std::vector<char> reached(polygons.size(), 0);
+	for(size_t i = 0; i != polygons.size(); ++i) {
+		if(reached[i]) continue;
+		std::vector<int> component(1, i);
+		reached[i] = 1;
+		for(size_t k = 0; k != component.size(); ++k) {
+			int p = component[k];
+			for(int j = 0, sz = polygons.polygonSize(p); j != sz; ++j) {
+				long long key = EdgeKey(polygons[p][j], polygons[p][(j + 1) % sz]);
+				std::multimap<long long, int>::const_iterator it = edges.lower_bound(key);
+				for(; it != edges.end() && it->first == key; ++it)
+					if(!reached[it->second]) {
+						reached[it->second] = 1;
+						component.push_back(it->second);
+					}
+			}
+		}
+		std::sort(component.begin(), component.end());
+		components.push_back(&component[0], component.size());
+	}
+}
+
+static bool operator==(PolygonList const& p1, PolygonList const& p2) {
+	return p1.offsets == p2.offsets && p1.indices == p2.indices;
+}
+
+static void TestConnectedComponents() {
+	std::vector<PlyValueVertex<float> > vertices;
+	PolygonList polygons;
+	SetMesh(vertices, polygons);
+	PolygonList serial;
+	SetSerialComponents(polygons, serial);
+	Check(serial.size() == 6, "SetSerialComponents count", polygons.size(), 1);
+	for(int t = 0; t != THREAD_COUNTS; ++t) {
+		PolygonList components;
+		SetConnectedComponents(polygons, components, THREADS[t]);
+		Check(components == serial, "SetConnectedComponents", polygons.size(), THREADS[t]);
+	}
+	PolygonList components;
+	SetConnectedComponents(PolygonList(), components, 4);
+	Check(components.size() == 0, "SetConnectedComponents of no polygons", 0, 4);
+}
+
+// The components and their areas on either side of the trimming value, and the trimmed mesh, against
+// the serial reference and the single-threaded trimming
+static void TestTrimming() {
+	std::vector<PlyValueVertex<float> > vertices;
+	PolygonList polygons;
+	SetMesh(vertices, polygons);
+	std::vector<PlyValueVertex<float> > serialVertices(vertices);
+	PolygonList ltPolygons;
+	PolygonList gtPolygons;
+	std::vector<char> ltFlags;
+	std::vector<char> gtFlags;
+	SplitPolygons(polygons, serialVertices, 0.9f, ltPolygons, gtPolygons, ltFlags, gtFlags, 1);
+	PolygonList serialComponents;
+	SetSerialComponents(gtPolygons, serialComponents);
+	std::vector<double> serialAreas(serialComponents.size(), 0);
+	for(size_t c = 0; c != serialComponents.size(); ++c)
+		for(int j = 0; j != serialComponents.polygonSize(c); ++j) {
+			int p = serialComponents[c][j];
+			serialAreas[c] += PolygonArea(serialVertices, gtPolygons[p], gtPolygons.polygonSize(p));
+		}
+	Check(serialComponents.size() > 10, "SplitPolygons islands", gtPolygons.size(), 1);
+
+	for(int polygonMesh = 0; polygonMesh != 2; ++polygonMesh) {
+		std::vector<PlyValueVertex<float> > trimmedVertices(vertices);
+		PolygonList trimmed(polygons);
+		TrimSurface(trimmedVertices, trimmed, 0.9f, 0.01f, polygonMesh, 1);
+		Check(trimmed.size() != 0, "TrimSurface", polygons.size(), 1);
+		for(int t = 0; t != THREAD_COUNTS; ++t) {
+			int threads = THREADS[t];
+			std::vector<PlyValueVertex<float> > v(vertices);
+			PolygonList lt;
+			PolygonList gt;
+			std::vector<char> ltf;
+			std::vector<char> gtf;
+			SplitPolygons(polygons, v, 0.9f, lt, gt, ltf, gtf, threads);
+			PolygonList components;
+			SetConnectedComponents(gt, components, threads);
+			std::vector<double> areas;
+			std::vector<char> componentFlags;
+			SetComponentAreas(v, gt, gtf, components, areas, componentFlags, threads);
+			Check(components == serialComponents, "Trimmed components", gt.size(), threads);
+			Check(areas == serialAreas, "Trimmed component areas", gt.size(), threads);
+
+			PolygonList p(polygons);
+			TrimSurface(v = vertices, p, 0.9f, 0.01f, polygonMesh, threads);
+			bool same = p == trimmed && v.size() == trimmedVertices.size();
+			for(size_t i = 0; same && i != v.size(); ++i)
+				same = !memcmp(&v[i].point, &trimmedVertices[i].point, sizeof(v[i].point))
+						&& v[i].value == trimmedVertices[i].value;
+			Check(same, polygonMesh ? "TrimSurface of polygons" : "TrimSurface of triangles", p.size(),
+					threads);
+		}
+	}
+}
+
+int main() {
+	TestParallelSort();
+	TestParallelRank();
+	TestConnectedComponents();
+	TestTrimming();
+	if(failures) {
+		printf("%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("All checks passed\n");
+	return EXIT_SUCCESS;
+}